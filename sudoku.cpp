@@ -8,283 +8,5623 @@
 #include <cstdlib>
 #include <optional>
 #include <numeric>
+#include <cstdint>
+#include <cmath>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <array>
+#include <type_traits>
+#include <limits>
+#include <new>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <csignal>
 
 using namespace std;
 
-class Sudoku {
-private:
-    static constexpr int DEFAULT_SIZE = 9;
-    static constexpr double DEFAULT_DIFFICULTY = 0.7;
-    static constexpr int VISUALIZATION_DELAY_MS = 100;
-    static constexpr int BACKTRACK_DELAY_MS = 50;
-    
-    int size;
-    int boxSize;
-    vector<vector<int>> board;
-    vector<vector<int>> solution;
-    function<bool(Sudoku&, function<void()>)> solver;
-    int steps;
-    mt19937 rng;
+#ifndef SUDOKU_ENABLE_STATS
+#define SUDOKU_ENABLE_STATS 1
+#endif
+
+#if SUDOKU_ENABLE_STATS
+#define SUDOKU_STAT(statement) statement
+#else
+#define SUDOKU_STAT(statement) do {} while (false)
+#endif
+
+// Benchmark-only instrumentation: replaces the global allocator to count heap
+// allocations per thread for the --bench "allocs" column. Off by default;
+// build the benchmark binary with -DSUDOKU_COUNT_ALLOCATIONS=1.
+#ifndef SUDOKU_COUNT_ALLOCATIONS
+#define SUDOKU_COUNT_ALLOCATIONS 0
+#endif
+
+#if SUDOKU_COUNT_ALLOCATIONS
+thread_local long long threadAllocationCount = 0;
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    ++threadAllocationCount;
+    if (void* memory = malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+// Kept out of line so GCC does not pair the inlined malloc()/free() with
+// the call sites and raise -Wmismatched-new-delete.
+__attribute__((noinline)) void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+#endif
+
+inline long long allocationsOnThisThread() {
+#if SUDOKU_COUNT_ALLOCATIONS
+    return threadAllocationCount;
+#else
+    return 0;
+#endif
+}
 
+#ifndef SUDOKU_ENABLE_TRACE
+#define SUDOKU_ENABLE_TRACE 1
+#endif
+
+// Spans are recorded into a fixed ring per thread (the oldest are overwritten)
+// and exported as Chrome trace JSON. Recording is off until enable() is called;
+// a disabled span costs one relaxed load, and -DSUDOKU_ENABLE_TRACE=0 removes it.
+class TraceRecorder {
 public:
-    explicit Sudoku(int boardSize = DEFAULT_SIZE, 
-                   function<bool(Sudoku&, function<void()>)> solverFunc = nullptr)
-        : size(boardSize), boxSize(static_cast<int>(sqrt(boardSize))), 
-          board(createEmptyBoard()), solver(solverFunc), steps(0),
-          rng(chrono::steady_clock::now().time_since_epoch().count()) {
-        generatePuzzle();
+    static constexpr size_t RING_EVENTS = 1 << 16;
+
+    struct Event {
+        const char* name;
+        int64_t startNs;
+        int64_t durationNs;
+    };
+
+    static void enable() {
+        epoch();
+        enabled.store(true, memory_order_relaxed);
     }
 
-    bool solve() {
-        if (!solver) {
-            throw runtime_error("No solver function provided");
-        }
-        
-        displayBoard();
-        cout << "\nInitial board. Starting solver in 2 seconds...\n" << endl;
-        this_thread::sleep_for(chrono::seconds(2));
-        
-        return solver(*this, [this]() { displayBoard(); });
+    static bool isEnabled() {
+        return enabled.load(memory_order_relaxed);
     }
 
-    void displayBoard() const {
-        system("clear");
-        cout << "\n  SUDOKU SOLVER v1.0  |  Steps: " << steps << "\n" << endl;
-        
-        string horizontalLine = createHorizontalLine();
-        
-        for (int i = 0; i < size; ++i) {
-            if (i % boxSize == 0) {
-                cout << horizontalLine << endl;
+    static int64_t now() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch()).count();
+    }
+
+    static void record(const char* name, int64_t startNs, int64_t endNs) {
+        Ring& ring = threadRing();
+        size_t head = ring.head.load(memory_order_relaxed);
+        ring.events[head % RING_EVENTS] = {name, startNs, endNs - startNs};
+        ring.head.store(head + 1, memory_order_release);
+    }
+
+    // Call once the traced work has finished; rings of exited threads are kept.
+    static bool writeChromeTrace(const string& path) {
+        FILE* out = fopen(path.c_str(), "wb");
+        if (out == nullptr) {
+            return false;
+        }
+        fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+        bool first = true;
+        lock_guard<mutex> lock(registryMutex());
+        for (const auto& ring : registry()) {
+            size_t head = ring->head.load(memory_order_acquire);
+            for (size_t i = head > RING_EVENTS ? head - RING_EVENTS : 0; i < head; ++i) {
+                const Event& event = ring->events[i % RING_EVENTS];
+                fprintf(out, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        first ? "" : ",", event.name, ring->threadId,
+                        event.startNs / 1000.0, event.durationNs / 1000.0);
+                first = false;
             }
-            
-            cout << createRowString(i) << endl;
         }
-        
-        cout << horizontalLine << "\n" << endl;
+        fputs("\n]}\n", out);
+        return fclose(out) == 0;
     }
 
-    vector<vector<int>>& getBoard() { return board; }
-    const vector<vector<int>>& getBoard() const { return board; }
-    int getSize() const { return size; }
-    int& getSteps() { return steps; }
-    bool isValidPlacement(int row, int col, int num) const {
-        return isValidInRow(row, num) && 
-               isValidInColumn(col, num) && 
-               isValidInBox(row, col, num);
+private:
+    struct Ring {
+        int threadId = 0;
+        atomic<size_t> head{0};
+        vector<Event> events = vector<Event>(RING_EVENTS);
+    };
+
+    static inline atomic<bool> enabled{false};
+
+    static chrono::steady_clock::time_point epoch() {
+        static const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        return start;
     }
 
+    static mutex& registryMutex() {
+        static mutex registryLock;
+        return registryLock;
+    }
+
+    static vector<shared_ptr<Ring>>& registry() {
+        static vector<shared_ptr<Ring>> rings;
+        return rings;
+    }
+
+    static Ring& threadRing() {
+        thread_local shared_ptr<Ring> ring;
+        if (!ring) {
+            ring = make_shared<Ring>();
+            lock_guard<mutex> lock(registryMutex());
+            ring->threadId = static_cast<int>(registry().size()) + 1;
+            registry().push_back(ring);
+        }
+        return *ring;
+    }
+};
+
+class TraceSpan {
 private:
-    vector<vector<int>> createEmptyBoard() const {
-        return vector<vector<int>>(size, vector<int>(size, 0));
+    const char* name;
+    int64_t startNs;
+
+public:
+    explicit TraceSpan(const char* spanName)
+        : name(spanName), startNs(TraceRecorder::isEnabled() ? TraceRecorder::now() : -1) {}
+
+    ~TraceSpan() {
+        if (startNs >= 0) {
+            TraceRecorder::record(name, startNs, TraceRecorder::now());
+        }
     }
 
-    void generatePuzzle() {
-        fillDiagonalBoxes();
-        solveBoard(board);
-        solution = board;
-        removeDigits(DEFAULT_DIFFICULTY);
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+// Enables recording for its lifetime and writes the trace when it ends, so
+// every command in main() is covered whichever way it returns.
+class TraceSession {
+private:
+    string path;
+
+public:
+    explicit TraceSession(string tracePath) : path(move(tracePath)) {
+        if (!path.empty()) {
+            TraceRecorder::enable();
+        }
     }
 
-    void fillDiagonalBoxes() {
-        for (int i = 0; i < size; i += boxSize) {
-            fillBox(i, i);
+    ~TraceSession() {
+        if (!path.empty() && !TraceRecorder::writeChromeTrace(path)) {
+            cerr << "Cannot write trace " << path << ": " << strerror(errno) << endl;
         }
     }
 
-    void fillBox(int startRow, int startCol) {
-        vector<int> numbers(size);
-        iota(numbers.begin(), numbers.end(), 1);
-        shuffle(numbers.begin(), numbers.end(), rng);
+    TraceSession(const TraceSession&) = delete;
+    TraceSession& operator=(const TraceSession&) = delete;
+};
 
-        int index = 0;
-        for (int i = 0; i < boxSize; ++i) {
-            for (int j = 0; j < boxSize; ++j) {
-                board[startRow + i][startCol + j] = numbers[index++];
-            }
+#define SUDOKU_TRACE_CONCAT_INNER(a, b) a##b
+#define SUDOKU_TRACE_CONCAT(a, b) SUDOKU_TRACE_CONCAT_INNER(a, b)
+#if SUDOKU_ENABLE_TRACE
+#define SUDOKU_TRACE_SPAN(name) TraceSpan SUDOKU_TRACE_CONCAT(traceSpan, __LINE__)(name)
+#else
+#define SUDOKU_TRACE_SPAN(name) do {} while (false)
+#endif
+
+struct SolveStats {
+    long long guesses = 0;
+    long long backtracks = 0;
+    long long propagationRounds = 0;
+    long long nakedSingles = 0;
+    long long hiddenSingles = 0;
+    long long lockedCandidates = 0;
+    long long nakedSubsets = 0;
+    long long hiddenSubsets = 0;
+    long long xWings = 0;
+    int maxDepth = 0;
+
+    void noteDepth(int depth) {
+        maxDepth = max(maxDepth, depth);
+    }
+
+    SolveStats& operator+=(const SolveStats& other) {
+        guesses += other.guesses;
+        backtracks += other.backtracks;
+        propagationRounds += other.propagationRounds;
+        nakedSingles += other.nakedSingles;
+        hiddenSingles += other.hiddenSingles;
+        lockedCandidates += other.lockedCandidates;
+        nakedSubsets += other.nakedSubsets;
+        hiddenSubsets += other.hiddenSubsets;
+        xWings += other.xWings;
+        maxDepth = max(maxDepth, other.maxDepth);
+        return *this;
+    }
+};
+
+enum class AbortReason {
+    None,
+    Deadline,
+    StepBudget,
+    Cancelled
+};
+
+struct SolveResult {
+    bool solved;
+    int steps;
+    AbortReason abortReason = AbortReason::None;
+};
+
+template <typename Mask>
+inline int countCandidates(Mask mask) {
+    return __builtin_popcountll(mask);
+}
+
+template <typename Mask>
+inline int lowestCandidate(Mask mask) {
+    return __builtin_ctzll(mask) + 1;
+}
+
+template <typename Mask>
+void computeCandidateRow(const uint8_t* cells, Mask rowMask, const Mask* colMasks,
+                         const Mask* boxByCol, Mask fullMask, Mask* out, int size) {
+    int col = 0;
+#if defined(__AVX2__)
+    if constexpr (sizeof(Mask) == 4) {
+        __m256i row = _mm256_set1_epi32(static_cast<int>(rowMask));
+        __m256i full = _mm256_set1_epi32(static_cast<int>(fullMask));
+        __m256i zero = _mm256_setzero_si256();
+        for (; col + 8 <= size; col += 8) {
+            __m256i used = _mm256_or_si256(row, _mm256_or_si256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colMasks + col)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(boxByCol + col))));
+            __m256i values = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(cells + col)));
+            __m256i empty = _mm256_cmpeq_epi32(values, zero);
+            __m256i candidates = _mm256_and_si256(_mm256_andnot_si256(used, full), empty);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + col), candidates);
+        }
+    } else if constexpr (sizeof(Mask) == 8) {
+        __m256i row = _mm256_set1_epi64x(static_cast<long long>(rowMask));
+        __m256i full = _mm256_set1_epi64x(static_cast<long long>(fullMask));
+        __m256i zero = _mm256_setzero_si256();
+        for (; col + 4 <= size; col += 4) {
+            __m256i used = _mm256_or_si256(row, _mm256_or_si256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(colMasks + col)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(boxByCol + col))));
+            int packed;
+            memcpy(&packed, cells + col, sizeof(packed));
+            __m256i values = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(packed));
+            __m256i empty = _mm256_cmpeq_epi64(values, zero);
+            __m256i candidates = _mm256_and_si256(_mm256_andnot_si256(used, full), empty);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + col), candidates);
+        }
+    }
+#elif defined(__ARM_NEON)
+    if constexpr (sizeof(Mask) == 4) {
+        uint32x4_t row = vdupq_n_u32(rowMask);
+        uint32x4_t full = vdupq_n_u32(fullMask);
+        for (; col + 4 <= size; col += 4) {
+            uint32x4_t used = vorrq_u32(row, vorrq_u32(vld1q_u32(colMasks + col), vld1q_u32(boxByCol + col)));
+            uint32_t lanes[4] = {cells[col], cells[col + 1], cells[col + 2], cells[col + 3]};
+            uint32x4_t empty = vceqq_u32(vld1q_u32(lanes), vdupq_n_u32(0));
+            vst1q_u32(out + col, vandq_u32(vbicq_u32(full, used), empty));
         }
+    } else if constexpr (sizeof(Mask) == 8) {
+        uint64x2_t row = vdupq_n_u64(rowMask);
+        uint64x2_t full = vdupq_n_u64(fullMask);
+        for (; col + 2 <= size; col += 2) {
+            uint64x2_t used = vorrq_u64(row, vorrq_u64(vld1q_u64(colMasks + col), vld1q_u64(boxByCol + col)));
+            uint64_t lanes[2] = {cells[col], cells[col + 1]};
+            uint64x2_t empty = vceqq_u64(vld1q_u64(lanes), vdupq_n_u64(0));
+            vst1q_u64(out + col, vandq_u64(vbicq_u64(full, used), empty));
+        }
+    }
+#endif
+    for (; col < size; ++col) {
+        Mask candidates = static_cast<Mask>(~(rowMask | colMasks[col] | boxByCol[col]) & fullMask);
+        out[col] = cells[col] == 0 ? candidates : 0;
     }
+}
 
-    bool solveBoard(vector<vector<int>>& targetBoard) {
-        auto emptyCell = findEmptyCell(targetBoard);
-        if (!emptyCell.has_value()) {
-            return true;
+template <typename Mask>
+void computeCandidateMasks(const uint8_t* cells, const Mask* rowMasks, const Mask* colMasks,
+                           const Mask* boxMasks, int size, int boxSize, Mask fullMask, Mask* out) {
+    constexpr int MAX_WIDTH = 64;
+    Mask boxByCol[MAX_WIDTH];
+    
+    for (int band = 0; band < size; band += boxSize) {
+        for (int col = 0; col < size; ++col) {
+            boxByCol[col] = boxMasks[band + col / boxSize];
         }
+        for (int row = band; row < band + boxSize; ++row) {
+            computeCandidateRow(cells + row * size, rowMasks[row], colMasks, boxByCol, fullMask,
+                                out + row * size, size);
+        }
+    }
+}
 
-        auto [row, col] = emptyCell.value();
-        for (int num = 1; num <= size; ++num) {
-            if (isValidPlacement(targetBoard, row, col, num)) {
-                targetBoard[row][col] = num;
-                
-                if (solveBoard(targetBoard)) {
-                    board = targetBoard;
-                    return true;
-                }
-                
-                targetBoard[row][col] = 0;
-            }
+// Values 1..9 print as digits and larger values continue through the alphabet,
+// so a 36x36 board still has one character per cell.
+constexpr char BOARD_SYMBOLS[] = "123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ@";
+constexpr int MAX_SYMBOL_VALUE = sizeof(BOARD_SYMBOLS) - 1;
+
+inline char symbolForValue(int value) {
+    return value == 0 ? '.' : BOARD_SYMBOLS[value - 1];
+}
+
+// Returns 0 for an empty cell and -1 for a character that is not a symbol.
+inline int valueForSymbol(char symbol) {
+    if (symbol == '.' || symbol == '0') {
+        return 0;
+    }
+    if (symbol >= '1' && symbol <= '9') {
+        return symbol - '0';
+    }
+    if (symbol >= 'A' && symbol <= 'Z') {
+        return symbol - 'A' + 10;
+    }
+    if (symbol >= 'a' && symbol <= 'z') {
+        return symbol - 'a' + 10;
+    }
+    return symbol == '@' ? MAX_SYMBOL_VALUE : -1;
+}
+
+// Packed boards store each cell in the fewest bits that hold 0..size, as a
+// little-endian bit stream: 41 bytes for a 9x9 board instead of an 82-byte line.
+inline int packedBitsPerCell(int boardSize) {
+    int bits = 1;
+    while ((1 << bits) <= boardSize) {
+        ++bits;
+    }
+    return bits;
+}
+
+inline size_t packedRecordBytes(int boardSize) {
+    return (static_cast<size_t>(boardSize) * boardSize * packedBitsPerCell(boardSize) + 7) / 8;
+}
+
+inline int unpackCell(const uint8_t* record, int cell, int bits) {
+    int bit = cell * bits;
+    int shift = bit & 7;
+    unsigned window = record[bit >> 3];
+    if (shift + bits > 8) {
+        window |= static_cast<unsigned>(record[(bit >> 3) + 1]) << 8;
+    }
+    return static_cast<int>((window >> shift) & ((1u << bits) - 1));
+}
+
+inline void packCells(const uint8_t* cells, int cellCount, int bits, uint8_t* out) {
+    memset(out, 0, (static_cast<size_t>(cellCount) * bits + 7) / 8);
+    for (int cell = 0; cell < cellCount; ++cell) {
+        int bit = cell * bits;
+        unsigned value = static_cast<unsigned>(cells[cell]) << (bit & 7);
+        out[bit >> 3] |= static_cast<uint8_t>(value);
+        if ((bit & 7) + bits > 8) {
+            out[(bit >> 3) + 1] |= static_cast<uint8_t>(value >> 8);
         }
-        
-        return false;
     }
+}
 
-    void removeDigits(double difficulty) {
-        int cellsToRemove = static_cast<int>(size * size * difficulty);
-        
-        vector<pair<int, int>> allCells;
-        for (int i = 0; i < size; ++i) {
-            for (int j = 0; j < size; ++j) {
-                allCells.emplace_back(i, j);
+enum class ValidationIssue {
+    None,
+    BadValue,
+    Incomplete,
+    Conflict,
+    GivenMismatch
+};
+
+struct ValidationReport {
+    ValidationIssue issue = ValidationIssue::None;
+    int cell = -1;
+    int otherCell = -1;
+    int value = 0;
+
+    bool ok() const { return issue == ValidationIssue::None; }
+};
+
+inline int boxOfCell(int cell, int size, int boxSize) {
+    return (cell / size / boxSize) * boxSize + (cell % size) / boxSize;
+}
+
+// One pass over the board with row, column and box masks; the first cell that
+// breaks a rule is reported, with the earlier cell it clashes with.
+inline ValidationReport validateCells(const uint8_t* cells, int size, int boxSize, bool requireComplete) {
+    uint64_t rows[MAX_SYMBOL_VALUE] = {};
+    uint64_t cols[MAX_SYMBOL_VALUE] = {};
+    uint64_t boxes[MAX_SYMBOL_VALUE] = {};
+    
+    for (int cell = 0; cell < size * size; ++cell) {
+        int value = cells[cell];
+        if (value == 0) {
+            if (requireComplete) {
+                return {ValidationIssue::Incomplete, cell, -1, 0};
             }
+            continue;
+        }
+        if (value > size) {
+            return {ValidationIssue::BadValue, cell, -1, value};
         }
         
-        shuffle(allCells.begin(), allCells.end(), rng);
-        
-        for (int i = 0; i < min(cellsToRemove, static_cast<int>(allCells.size())); ++i) {
-            auto [row, col] = allCells[i];
-            board[row][col] = 0;
+        int row = cell / size;
+        int col = cell % size;
+        int box = boxOfCell(cell, size, boxSize);
+        uint64_t bit = uint64_t(1) << (value - 1);
+        if (((rows[row] | cols[col] | boxes[box]) & bit) != 0) {
+            int other = 0;
+            while (cells[other] != value ||
+                   (other / size != row && other % size != col && boxOfCell(other, size, boxSize) != box)) {
+                ++other;
+            }
+            return {ValidationIssue::Conflict, cell, other, value};
         }
+        rows[row] |= bit;
+        cols[col] |= bit;
+        boxes[box] |= bit;
     }
+    return {};
+}
 
-    optional<pair<int, int>> findEmptyCell(const vector<vector<int>>& targetBoard) const {
-        for (int i = 0; i < size; ++i) {
-            for (int j = 0; j < size; ++j) {
-                if (targetBoard[i][j] == 0) {
-                    return make_pair(i, j);
+inline ValidationReport verifySolution(const uint8_t* puzzle, const uint8_t* solution, int size, int boxSize) {
+    for (int cell = 0; cell < size * size; ++cell) {
+        if (puzzle[cell] != 0 && puzzle[cell] != solution[cell]) {
+            return {ValidationIssue::GivenMismatch, cell, -1, puzzle[cell]};
+        }
+    }
+    return validateCells(solution, size, boxSize, true);
+}
+
+inline string describeValidation(const ValidationReport& report, int size) {
+    auto position = [size](int cell) {
+        return "r" + to_string(cell / size + 1) + "c" + to_string(cell % size + 1);
+    };
+    switch (report.issue) {
+        case ValidationIssue::None:
+            return "ok";
+        case ValidationIssue::BadValue:
+            return "value " + to_string(report.value) + " out of range at " + position(report.cell);
+        case ValidationIssue::Incomplete:
+            return "empty cell at " + position(report.cell);
+        case ValidationIssue::Conflict:
+            return string("conflict: ") + symbolForValue(report.value) + " at " + position(report.cell)
+                 + " repeats " + position(report.otherCell);
+        case ValidationIssue::GivenMismatch:
+            return string("given ") + symbolForValue(report.value) + " at " + position(report.cell) + " was changed";
+    }
+    return "unknown";
+}
+
+// Checks count solved boards stored back to back, writing 1 to valid[i] when
+// board i is complete and consistent. The AVX2 path checks eight boards per
+// pass, one per lane; a complete board is valid exactly when no unit repeats a
+// bit and every unit's mask is full.
+inline void validateBatch(const uint8_t* boards, size_t count, int size, int boxSize, uint8_t* valid) {
+    size_t cellCount = static_cast<size_t>(size) * size;
+    size_t board = 0;
+#if defined(__AVX2__)
+    if (size <= 32) {
+        constexpr int LANES = 8;
+        __m256i rows[32];
+        __m256i cols[32];
+        __m256i boxes[32];
+        __m256i one = _mm256_set1_epi32(1);
+        __m256i low = _mm256_set1_epi32(0xFF);
+        __m256i full = _mm256_set1_epi32(static_cast<int>((uint64_t(1) << size) - 1));
+        __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                             _mm256_set1_epi32(static_cast<int>(cellCount)));
+        // The gather reads four bytes per lane, so the last board is left to
+        // the scalar loop to stay inside the buffer.
+        for (; board + LANES < count; board += LANES) {
+            const uint8_t* base = boards + board * cellCount;
+            __m256i zero = _mm256_setzero_si256();
+            for (int unit = 0; unit < size; ++unit) {
+                rows[unit] = cols[unit] = boxes[unit] = zero;
+            }
+            __m256i repeated = zero;
+            int cell = 0;
+            for (int row = 0; row < size; ++row) {
+                for (int col = 0; col < size; ++col, ++cell) {
+                    int box = (row / boxSize) * boxSize + col / boxSize;
+                    __m256i values = _mm256_and_si256(
+                        _mm256_i32gather_epi32(reinterpret_cast<const int*>(base + cell), offsets, 1), low);
+                    __m256i bit = _mm256_sllv_epi32(one, _mm256_sub_epi32(values, one));
+                    __m256i seen = _mm256_or_si256(rows[row], _mm256_or_si256(cols[col], boxes[box]));
+                    repeated = _mm256_or_si256(repeated, _mm256_and_si256(seen, bit));
+                    rows[row] = _mm256_or_si256(rows[row], bit);
+                    cols[col] = _mm256_or_si256(cols[col], bit);
+                    boxes[box] = _mm256_or_si256(boxes[box], bit);
                 }
             }
+            __m256i good = _mm256_cmpeq_epi32(repeated, zero);
+            for (int unit = 0; unit < size; ++unit) {
+                good = _mm256_and_si256(good, _mm256_cmpeq_epi32(rows[unit], full));
+                good = _mm256_and_si256(good, _mm256_cmpeq_epi32(cols[unit], full));
+                good = _mm256_and_si256(good, _mm256_cmpeq_epi32(boxes[unit], full));
+            }
+            int laneMask = _mm256_movemask_ps(_mm256_castsi256_ps(good));
+            for (int lane = 0; lane < LANES; ++lane) {
+                valid[board + lane] = static_cast<uint8_t>((laneMask >> lane) & 1);
+            }
         }
-        return nullopt;
     }
+#endif
+    for (; board < count; ++board) {
+        valid[board] = validateCells(boards + board * cellCount, size, boxSize, true).ok() ? 1 : 0;
+    }
+}
+
+inline uint64_t mixSeed(uint64_t base, uint64_t index) {
+    uint64_t z = base + (index + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+inline uint64_t randomSeed() {
+    uint64_t entropy = (static_cast<uint64_t>(random_device{}()) << 32) ^ random_device{}();
+    return mixSeed(entropy, static_cast<uint64_t>(chrono::steady_clock::now().time_since_epoch().count()));
+}
+
+class Arena {
+private:
+    unique_ptr<unsigned char[]> buffer;
+    size_t capacity;
+    size_t used;
+
+public:
+    Arena() : capacity(0), used(0) {}
+
+    explicit Arena(size_t bytes)
+        : buffer(new unsigned char[bytes]), capacity(bytes), used(0) {}
+
+    void* allocate(size_t bytes, size_t alignment = alignof(max_align_t)) {
+        size_t start = (used + alignment - 1) & ~(alignment - 1);
+        if (start + bytes > capacity) {
+            throw bad_alloc();
+        }
+        used = start + bytes;
+        return buffer.get() + start;
+    }
+
+    void reset() { used = 0; }
+    size_t getCapacity() const { return capacity; }
+    size_t getUsed() const { return used; }
+};
+
+// Draws the board on its own thread. Solvers publish snapshots through the
+// display hook and the render thread samples the latest one at a fixed rate,
+// so the solver never waits on the terminal. After the first full frame only
+// the cells that changed are rewritten, each frame in a single write().
+class BoardRenderer {
+private:
+    int size;
+    int boxSize;
+    chrono::nanoseconds frameInterval;
+    mutex snapshotMutex;
+    condition_variable stopSignal;
+    vector<uint8_t> latest;
+    int latestSteps = 0;
+    bool dirty = false;
+    bool stopping = false;
+    vector<uint8_t> frameCells;
+    vector<uint8_t> shownCells;
+    int shownSteps = -1;
+    bool hasFrame = false;
+    string frame;
+    thread worker;
 
-    bool isValidPlacement(const vector<vector<int>>& targetBoard, int row, int col, int num) const {
-        return isValidInRow(targetBoard, row, num) && 
-               isValidInColumn(targetBoard, col, num) && 
-               isValidInBox(targetBoard, row, col, num);
+public:
+    BoardRenderer(int boardSize, int boxWidth, int framesPerSecond)
+        : size(boardSize), boxSize(boxWidth),
+          frameInterval(chrono::nanoseconds(1000000000LL / max(1, framesPerSecond))),
+          latest(boardSize * boardSize, 0), frameCells(boardSize * boardSize, 0),
+          shownCells(boardSize * boardSize, 0) {
+        frame.reserve(static_cast<size_t>(boardSize) * boardSize * 20 + 1024);
     }
 
-    bool isValidInRow(const vector<vector<int>>& targetBoard, int row, int num) const {
-        return find(targetBoard[row].begin(), targetBoard[row].end(), num) == targetBoard[row].end();
+    ~BoardRenderer() { stop(); }
+
+    void publish(const uint8_t* cells, int steps) {
+        lock_guard<mutex> lock(snapshotMutex);
+        copy(cells, cells + latest.size(), latest.begin());
+        latestSteps = steps;
+        dirty = true;
     }
 
-    bool isValidInColumn(const vector<vector<int>>& targetBoard, int col, int num) const {
-        for (int i = 0; i < size; ++i) {
-            if (targetBoard[i][col] == num) {
-                return false;
-            }
+    void start() {
+        stopping = false;
+        worker = thread([this]() { run(); });
+    }
+
+    void stop() {
+        if (!worker.joinable()) {
+            return;
         }
-        return true;
+        {
+            lock_guard<mutex> lock(snapshotMutex);
+            stopping = true;
+        }
+        stopSignal.notify_one();
+        worker.join();
+        drawLatest();
     }
 
-    bool isValidInBox(const vector<vector<int>>& targetBoard, int row, int col, int num) const {
-        int boxRow = row - row % boxSize;
-        int boxCol = col - col % boxSize;
-        
-        for (int i = 0; i < boxSize; ++i) {
-            for (int j = 0; j < boxSize; ++j) {
-                if (targetBoard[boxRow + i][boxCol + j] == num) {
-                    return false;
-                }
+    void draw(const uint8_t* cells, int steps) {
+        copy(cells, cells + frameCells.size(), frameCells.begin());
+        drawFrame(steps);
+    }
+
+    static void clearScreen() {
+        fputs("\033[2J\033[H", stdout);
+        fflush(stdout);
+    }
+
+private:
+    void run() {
+        unique_lock<mutex> lock(snapshotMutex);
+        while (!stopping) {
+            stopSignal.wait_for(lock, frameInterval, [this]() { return stopping; });
+            if (stopping || !dirty) {
+                continue;
             }
+            frameCells.swap(latest);
+            int steps = latestSteps;
+            dirty = false;
+            lock.unlock();
+            drawFrame(steps);
+            lock.lock();
+        }
+    }
+
+    void drawLatest() {
+        lock_guard<mutex> lock(snapshotMutex);
+        if (dirty) {
+            frameCells.swap(latest);
+            dirty = false;
+            drawFrame(latestSteps);
         }
-        return true;
     }
 
-    bool isValidInRow(int row, int num) const {
-        return isValidInRow(board, row, num);
+    void appendNumber(int value) {
+        char digits[12];
+        int length = snprintf(digits, sizeof(digits), "%d", value);
+        frame.append(digits, length);
     }
 
-    bool isValidInColumn(int col, int num) const {
-        return isValidInColumn(board, col, num);
+    void moveCursor(int line, int column) {
+        frame += "\033[";
+        appendNumber(line);
+        frame += ';';
+        appendNumber(column);
+        frame += 'H';
     }
 
-    bool isValidInBox(int row, int col, int num) const {
-        return isValidInBox(board, row, col, num);
+    void appendCell(int value) {
+        if (value == 0) {
+            frame += '.';
+            return;
+        }
+        frame += "\033[97m";
+        frame += symbolForValue(value);
+        frame += "\033[0m";
     }
 
-    string createHorizontalLine() const {
-        string line = "  ";
+    // Screen positions are 1-based and follow the layout drawFullFrame emits.
+    int lineOfRow(int row) const { return 5 + row + row / boxSize; }
+    int columnOfCol(int col) const { return 3 + (col / boxSize + 1) * 2 + col * 2; }
+    int lineBelowBoard() const { return 6 + size + boxSize; }
+
+    void appendHorizontalLine() {
+        frame += "  ";
         for (int i = 0; i < boxSize; ++i) {
-            if (i > 0) line += "+";
-            line += string(boxSize * 2 + 1, '-');
+            if (i > 0) frame += '+';
+            frame.append(boxSize * 2 + 1, '-');
         }
-        return line;
+        frame += "\033[K\n";
     }
 
-    string createRowString(int rowIndex) const {
-        string rowStr = "  ";
-        
-        for (int colIndex = 0; colIndex < size; ++colIndex) {
-            if (colIndex % boxSize == 0) {
-                rowStr += "| ";
+    void appendHeader(int steps) {
+        frame += "  SUDOKU SOLVER v1.0  |  Steps: ";
+        appendNumber(steps);
+        frame += "\033[K";
+    }
+
+    void drawFullFrame(int steps) {
+        frame += "\033[H\n";
+        appendHeader(steps);
+        frame += "\n\n";
+        for (int row = 0; row < size; ++row) {
+            if (row % boxSize == 0) {
+                appendHorizontalLine();
             }
-            
-            int cellValue = board[rowIndex][colIndex];
-            if (cellValue == 0) {
-                rowStr += ". ";
-            } else {
-                rowStr += "\033[97m" + to_string(cellValue) + "\033[0m ";
+            frame += "  ";
+            for (int col = 0; col < size; ++col) {
+                if (col % boxSize == 0) {
+                    frame += "| ";
+                }
+                appendCell(frameCells[row * size + col]);
+                frame += ' ';
             }
+            frame += "|\033[K\n";
         }
-        
-        return rowStr + "|";
+        appendHorizontalLine();
+        frame += '\n';
     }
-};
 
-bool bruteForceSolver(Sudoku& sudoku, function<void()> displayFunction) {
-    function<bool(int, int)> backtrack = [&](int row, int col) -> bool {
-        sudoku.getSteps()++;
-        
-        if (col == sudoku.getSize()) {
-            return backtrack(row + 1, 0);
+    void drawChangedCells(int steps) {
+        if (steps != shownSteps) {
+            moveCursor(2, 1);
+            appendHeader(steps);
         }
-        
-        if (row == sudoku.getSize()) {
-            return true;
+        for (int cell = 0; cell < size * size; ++cell) {
+            if (frameCells[cell] != shownCells[cell]) {
+                moveCursor(lineOfRow(cell / size), columnOfCol(cell % size));
+                appendCell(frameCells[cell]);
+            }
         }
-        
-        if (sudoku.getBoard()[row][col] != 0) {
-            return backtrack(row, col + 1);
+        moveCursor(lineBelowBoard(), 1);
+    }
+
+    void drawFrame(int steps) {
+        frame.clear();
+        if (hasFrame) {
+            drawChangedCells(steps);
+        } else {
+            drawFullFrame(steps);
+            hasFrame = true;
         }
+        shownCells = frameCells;
+        shownSteps = steps;
         
-        for (int num = 1; num <= sudoku.getSize(); ++num) {
-            if (sudoku.isValidPlacement(row, col, num)) {
-                sudoku.getBoard()[row][col] = num;
-                
-                displayFunction();
-                this_thread::sleep_for(chrono::milliseconds(100));
-                
-                if (backtrack(row, col + 1)) {
-                    return true;
-                }
-                
-                sudoku.getBoard()[row][col] = 0;
-                displayFunction();
-                this_thread::sleep_for(chrono::milliseconds(50));
+        fflush(stdout);
+        const char* data = frame.data();
+        size_t remaining = frame.size();
+        while (remaining > 0) {
+            ssize_t written = ::write(STDOUT_FILENO, data, remaining);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                break;
             }
+            data += written;
+            remaining -= static_cast<size_t>(written);
         }
-        
-        return false;
-    };
-    
-    bool isSolved = backtrack(0, 0);
-    
-    if (isSolved) {
-        displayFunction();
-        cout << "\nSolved successfully in " << sudoku.getSteps() << " steps!" << endl;
-    } else {
-        cout << "\nNo solution exists." << endl;
     }
-    
-    return isSolved;
-}
+};
+
+// A token may chain to a parent, so cancelling an outer solve also stops
+// the sub-searches it started.
+class CancellationToken {
+private:
+    atomic<bool> cancelled{false};
+    const CancellationToken* parent;
 
-int main() {
+public:
+    explicit CancellationToken(const CancellationToken* parentToken = nullptr) : parent(parentToken) {}
+
+    void cancel() { cancelled.store(true, memory_order_release); }
+    void reset() { cancelled.store(false, memory_order_relaxed); }
+    bool isCancelled() const {
+        return cancelled.load(memory_order_acquire) || (parent != nullptr && parent->isCancelled());
+    }
+};
+
+// Sub-searches of one solve share its budget: a fixed deadline replaces the
+// time limit, and sharedSteps collects every searcher's steps against the
+// step limit.
+struct SolveLimits {
+    chrono::nanoseconds timeLimit{0};
+    long long stepLimit = 0;
+    const CancellationToken* cancellation = nullptr;
+    optional<chrono::steady_clock::time_point> deadline;
+    atomic<long long>* sharedSteps = nullptr;
+};
+
+// Checked by the search loops once per node. Step budgets are compared every
+// call; the clock and the token are only polled every POLL_INTERVAL calls.
+// Shared step counts are published every SHARED_STEP_BATCH steps.
+class SolveGuard {
+private:
+    static constexpr unsigned POLL_INTERVAL = 1024;
+    static constexpr long long SHARED_STEP_BATCH = 64;
+
+    SolveLimits limits;
+    chrono::steady_clock::time_point deadline;
+    long long publishedSteps = 0;
+    unsigned pollCounter = 0;
+    AbortReason reason = AbortReason::None;
+    bool enabled = false;
+
+public:
+    void setLimits(const SolveLimits& solveLimits) { limits = solveLimits; }
+    const SolveLimits& getLimits() const { return limits; }
+
+    void start() {
+        reason = AbortReason::None;
+        pollCounter = 0;
+        publishedSteps = 0;
+        enabled = limits.timeLimit.count() > 0 || limits.deadline.has_value() || limits.stepLimit > 0 ||
+                  limits.cancellation != nullptr;
+        if (limits.deadline.has_value()) {
+            deadline = limits.deadline.value();
+            if (chrono::steady_clock::now() >= deadline) {
+                reason = AbortReason::Deadline;
+            }
+        } else if (limits.timeLimit.count() > 0) {
+            deadline = chrono::steady_clock::now() + limits.timeLimit;
+        }
+    }
+
+    // The absolute deadline of the running solve, if it has one.
+    optional<chrono::steady_clock::time_point> getDeadline() const {
+        if (limits.deadline.has_value() || limits.timeLimit.count() > 0) {
+            return deadline;
+        }
+        return nullopt;
+    }
+
+    // Publishes the steps not yet added to a shared count.
+    void finish(long long steps) {
+        if (limits.sharedSteps != nullptr) {
+            limits.sharedSteps->fetch_add(steps - publishedSteps, memory_order_relaxed);
+            publishedSteps = steps;
+        }
+    }
+
+    bool expired(long long steps) {
+        if (!enabled) {
+            return false;
+        }
+        if (reason != AbortReason::None) {
+            return true;
+        }
+        if (limits.stepLimit > 0 && spentSteps(steps) >= limits.stepLimit) {
+            reason = AbortReason::StepBudget;
+            return true;
+        }
+        if (++pollCounter % POLL_INTERVAL != 0) {
+            return false;
+        }
+        if (limits.cancellation != nullptr && limits.cancellation->isCancelled()) {
+            reason = AbortReason::Cancelled;
+        } else if ((limits.deadline.has_value() || limits.timeLimit.count() > 0) &&
+                   chrono::steady_clock::now() >= deadline) {
+            reason = AbortReason::Deadline;
+        }
+        return reason != AbortReason::None;
+    }
+
+    void abort(AbortReason abortReason) { reason = abortReason; }
+    AbortReason getAbortReason() const { return reason; }
+
+private:
+    long long spentSteps(long long steps) {
+        if (limits.sharedSteps == nullptr) {
+            return steps;
+        }
+        if (steps - publishedSteps >= SHARED_STEP_BATCH) {
+            limits.sharedSteps->fetch_add(steps - publishedSteps, memory_order_relaxed);
+            publishedSteps = steps;
+        }
+        return limits.sharedSteps->load(memory_order_relaxed) + steps - publishedSteps;
+    }
+};
+
+class Sudoku;
+using SolverFunction = function<bool(Sudoku&, function<void()>)>;
+
+class Sudoku {
+public:
+    static constexpr int VISUALIZATION_DELAY_MS = 100;
+    static constexpr int BACKTRACK_DELAY_MS = 50;
+    static constexpr int RENDER_FPS = 30;
+
+    using CandidateMask = uint64_t;
+
+    static constexpr int MAX_SIZE = MAX_SYMBOL_VALUE;
+
+private:
+    static constexpr int DEFAULT_SIZE = 9;
+    static constexpr double DEFAULT_DIFFICULTY = 0.7;
+    static constexpr long long UNIQUENESS_NODE_BUDGET = 20000;
+    static constexpr int MAX_INCONCLUSIVE_REMOVALS = 8;
+    
+    int size;
+    int boxSize;
+    int cellCount;
+    CandidateMask fullMask;
+    Arena ownedStorage;
+    size_t storageBytes;
+    unsigned char* storage;
+    CandidateMask* rowMasks;
+    CandidateMask* colMasks;
+    CandidateMask* boxMasks;
+    CandidateMask* candidateScratch;
+    int* cellOrder;
+    uint8_t* board;
+    uint8_t* solution;
+    uint8_t* rowOf;
+    uint8_t* colOf;
+    uint8_t* boxOf;
+    uint8_t* digitOrder;
+    SolverFunction solver;
+    int steps;
+    SolveStats stats;
+    SolveGuard guard;
+    bool pacedSteps = true;
+    mt19937_64 rng;
+
+    Sudoku(int boardSize, SolverFunction solverFunc, bool generate, Arena* arena)
+        : size(boardSize), boxSize(static_cast<int>(sqrt(boardSize))), 
+          cellCount(boardSize * boardSize),
+          fullMask(static_cast<CandidateMask>((uint64_t(1) << min(max(boardSize, 0), MAX_SIZE)) - 1)),
+          storageBytes(storageBytesFor(boardSize)), storage(nullptr),
+          solver(move(solverFunc)), steps(0),
+          rng(randomSeed()) {
+        if (size < 1 || size > MAX_SIZE) {
+            throw invalid_argument("Board size must be between 1 and " + to_string(MAX_SIZE));
+        }
+        if (boxSize * boxSize != size) {
+            throw invalid_argument("Board size must be a perfect square");
+        }
+        if (arena == nullptr) {
+            ownedStorage = Arena(storageBytes);
+            arena = &ownedStorage;
+        }
+        storage = static_cast<unsigned char*>(arena->allocate(storageBytes, alignof(CandidateMask)));
+        memset(storage, 0, storageBytes);
+        bindStorage();
+        buildIndexTables();
+        if (generate) {
+            generatePuzzle();
+        }
+    }
+
+public:
+    explicit Sudoku(int boardSize = DEFAULT_SIZE, SolverFunction solverFunc = nullptr)
+        : Sudoku(boardSize, move(solverFunc), true, nullptr) {}
+
+    static Sudoku createEmpty(int boardSize = DEFAULT_SIZE, SolverFunction solverFunc = nullptr,
+                              Arena* arena = nullptr) {
+        return Sudoku(boardSize, move(solverFunc), false, arena);
+    }
+
+    Sudoku(const Sudoku& other)
+        : size(other.size), boxSize(other.boxSize), cellCount(other.cellCount), fullMask(other.fullMask),
+          ownedStorage(other.storageBytes), storageBytes(other.storageBytes),
+          storage(static_cast<unsigned char*>(ownedStorage.allocate(storageBytes, alignof(CandidateMask)))),
+          solver(other.solver), steps(other.steps), stats(other.stats), guard(other.guard),
+          pacedSteps(other.pacedSteps),
+          rng(other.rng) {
+        memcpy(storage, other.storage, storageBytes);
+        bindStorage();
+    }
+
+    Sudoku(Sudoku&&) = default;
+    Sudoku& operator=(Sudoku&&) = default;
+
+    Sudoku& operator=(const Sudoku& other) {
+        if (this == &other) {
+            return *this;
+        }
+        if (storageBytes != other.storageBytes) {
+            return *this = Sudoku(other);
+        }
+        size = other.size;
+        boxSize = other.boxSize;
+        cellCount = other.cellCount;
+        fullMask = other.fullMask;
+        memcpy(storage, other.storage, storageBytes);
+        solver = other.solver;
+        steps = other.steps;
+        stats = other.stats;
+        guard = other.guard;
+        pacedSteps = other.pacedSteps;
+        rng = other.rng;
+        return *this;
+    }
+
+    // Every per-board array lives in one block, widest element type first so no
+    // padding is needed between them.
+    static size_t storageBytesFor(int boardSize) {
+        size_t cells = static_cast<size_t>(boardSize) * boardSize;
+        return (3 * boardSize + cells) * sizeof(CandidateMask) + cells * sizeof(int) + 5 * cells + boardSize;
+    }
+
+    // paced keeps the per-step demo delays; without it the solver runs at full
+    // speed and the renderer shows whatever state it samples each frame.
+    bool solve(int framesPerSecond = RENDER_FPS, bool paced = true) {
+        if (!solver) {
+            throw runtime_error("No solver function provided");
+        }
+        
+        displayBoard();
+        cout << "\nInitial board. Starting solver in 2 seconds...\n" << endl;
+        this_thread::sleep_for(chrono::seconds(2));
+        
+        BoardRenderer renderer(size, boxSize, framesPerSecond);
+        BoardRenderer::clearScreen();
+        renderer.start();
+        pacedSteps = paced;
+        bool isSolved;
+        {
+            SUDOKU_TRACE_SPAN("solver");
+            isSolved = solver(*this, [this, &renderer]() {
+                SUDOKU_TRACE_SPAN("display");
+                renderer.publish(board, steps);
+            });
+        }
+        pacedSteps = true;
+        renderer.stop();
+        
+        if (isSolved) {
+            renderer.draw(board, steps);
+            cout << "\nSolved successfully in " << steps << " steps!" << endl;
+        } else {
+            cout << "\nNo solution exists." << endl;
+        }
+        
+        return isSolved;
+    }
+
+    SolveResult solveHeadless() {
+        if (!solver) {
+            throw runtime_error("No solver function provided");
+        }
+        
+        steps = 0;
+        stats = SolveStats();
+        guard.start();
+        SUDOKU_TRACE_SPAN("solver");
+        bool isSolved = solver(*this, nullptr);
+        guard.finish(steps);
+        return {isSolved, steps, isSolved ? AbortReason::None : guard.getAbortReason()};
+    }
+
+    void displayBoard() const {
+        BoardRenderer::clearScreen();
+        BoardRenderer(size, boxSize, RENDER_FPS).draw(board, steps);
+    }
+
+    const uint8_t* getCells() const { return board; }
+    int getCell(int row, int col) const { return board[cellIndex(row, col)]; }
+    int getSize() const { return size; }
+    int getBoxSize() const { return boxSize; }
+    int getCellCount() const { return cellCount; }
+    int& getSteps() { return steps; }
+    SolveStats& getStats() { return stats; }
+    bool isPaced() const { return pacedSteps; }
+    SolveGuard& getGuard() { return guard; }
+    void setLimits(const SolveLimits& limits) { guard.setLimits(limits); }
+    void setSolver(SolverFunction solverFunc) { solver = move(solverFunc); }
+    bool searchExpired() { return guard.expired(steps); }
+    const SolveStats& getStats() const { return stats; }
+
+    int cellIndex(int row, int col) const { return row * size + col; }
+    int rowOfCell(int cell) const { return rowOf[cell]; }
+    int colOfCell(int cell) const { return colOf[cell]; }
+    int boxOfCell(int cell) const { return boxOf[cell]; }
+
+    CandidateMask getFullMask() const { return fullMask; }
+
+    CandidateMask getCandidates(int cell) const {
+        return ~(rowMasks[rowOf[cell]] | colMasks[colOf[cell]] | boxMasks[boxOf[cell]]) & fullMask;
+    }
+
+    static CandidateMask bitFor(int num) {
+        return CandidateMask(1) << (num - 1);
+    }
+
+    void computeAllCandidates(CandidateMask* out) const {
+        computeCandidateMasks(board, rowMasks, colMasks, boxMasks,
+                              size, boxSize, fullMask, out);
+    }
+
+    void generate(uint64_t seed) {
+        clearBoard();
+        rng.seed(seed);
+        generatePuzzle();
+    }
+
+    const uint8_t* getSolution() const { return solution; }
+
+    long long countSolutions(long long limit = numeric_limits<long long>::max()) {
+        long long nodeBudget = numeric_limits<long long>::max();
+        auto acceptAny = [](const uint8_t*) { return true; };
+        return visitSolutions(limit, nodeBudget, acceptAny);
+    }
+
+    long long enumerateSolutions(const function<bool(const uint8_t*)>& onSolution,
+                                 long long limit = numeric_limits<long long>::max()) {
+        long long found = 0;
+        long long nodeBudget = numeric_limits<long long>::max();
+        auto visit = [&](const uint8_t* cells) {
+            ++found;
+            return onSolution(cells);
+        };
+        visitSolutions(limit, nodeBudget, visit);
+        return found;
+    }
+
+    optional<pair<int, CandidateMask>> findMostConstrainedCell() {
+        computeAllCandidates(candidateScratch);
+        
+        optional<pair<int, CandidateMask>> best;
+        int bestCount = size + 1;
+        for (int cell = 0; cell < cellCount; ++cell) {
+            if (board[cell] != 0) {
+                continue;
+            }
+            int count = countCandidates(candidateScratch[cell]);
+            if (count < bestCount) {
+                best = make_pair(cell, candidateScratch[cell]);
+                bestCount = count;
+                if (count <= 1) {
+                    break;
+                }
+            }
+        }
+        return best;
+    }
+
+
+    bool loadPacked(const uint8_t* record) {
+        clearBoard();
+        
+        int bits = packedBitsPerCell(size);
+        for (int cell = 0; cell < cellCount; ++cell) {
+            int num = unpackCell(record, cell, bits);
+            if (num == 0) {
+                continue;
+            }
+            if (num > size || !isValidPlacement(cell, num)) {
+                return false;
+            }
+            place(cell, num);
+        }
+        return true;
+    }
+
+    void writePacked(uint8_t* out) const {
+        packCells(board, cellCount, packedBitsPerCell(size), out);
+    }
+
+    bool loadPuzzle(const char* text, size_t length) {
+        if (length != static_cast<size_t>(cellCount)) {
+            return false;
+        }
+        
+        clearBoard();
+        
+        for (int cell = 0; cell < cellCount; ++cell) {
+            int num = valueForSymbol(text[cell]);
+            if (num == 0) {
+                continue;
+            }
+            if (num < 1 || num > size || !isValidPlacement(cell, num)) {
+                return false;
+            }
+            place(cell, num);
+        }
+        return true;
+    }
+
+    void writeBoard(char* out) const {
+        for (int cell = 0; cell < cellCount; ++cell) {
+            out[cell] = symbolForValue(board[cell]);
+        }
+    }
+
+    ValidationReport validate(bool requireComplete = false) const {
+        return validateCells(board, size, boxSize, requireComplete);
+    }
+
+    ValidationReport verifyAgainst(const Sudoku& puzzle) const {
+        if (puzzle.size != size) {
+            return {ValidationIssue::BadValue, -1, -1, puzzle.size};
+        }
+        return verifySolution(puzzle.board, board, size, boxSize);
+    }
+
+    bool isValidPlacement(int row, int col, int num) const {
+        return isValidPlacement(cellIndex(row, col), num);
+    }
+
+    bool isValidPlacement(int cell, int num) const {
+        return ((rowMasks[rowOf[cell]] | colMasks[colOf[cell]] | boxMasks[boxOf[cell]]) & bitFor(num)) == 0;
+    }
+
+    void place(int row, int col, int num) { place(cellIndex(row, col), num); }
+    void unplace(int row, int col) { unplace(cellIndex(row, col)); }
+
+    void place(int cell, int num) {
+        CandidateMask bit = bitFor(num);
+        board[cell] = static_cast<uint8_t>(num);
+        rowMasks[rowOf[cell]] |= bit;
+        colMasks[colOf[cell]] |= bit;
+        boxMasks[boxOf[cell]] |= bit;
+    }
+
+    void unplace(int cell) {
+        CandidateMask bit = bitFor(board[cell]);
+        board[cell] = 0;
+        rowMasks[rowOf[cell]] &= ~bit;
+        colMasks[colOf[cell]] &= ~bit;
+        boxMasks[boxOf[cell]] &= ~bit;
+    }
+
+    // Places a solution's values in the cells that are still empty.
+    void fillFrom(const uint8_t* solved) {
+        for (int cell = 0; cell < cellCount; ++cell) {
+            if (board[cell] == 0) {
+                place(cell, solved[cell]);
+            }
+        }
+    }
+
+private:
+    void bindStorage() {
+        unsigned char* cursor = storage;
+        auto carve = [&cursor](auto*& target, size_t count) {
+            target = reinterpret_cast<remove_reference_t<decltype(target)>>(cursor);
+            cursor += sizeof(*target) * count;
+        };
+        carve(rowMasks, size);
+        carve(colMasks, size);
+        carve(boxMasks, size);
+        carve(candidateScratch, cellCount);
+        carve(cellOrder, cellCount);
+        carve(board, cellCount);
+        carve(solution, cellCount);
+        carve(rowOf, cellCount);
+        carve(colOf, cellCount);
+        carve(boxOf, cellCount);
+        carve(digitOrder, size);
+    }
+
+    void buildIndexTables() {
+        for (int cell = 0; cell < cellCount; ++cell) {
+            int row = cell / size;
+            int col = cell % size;
+            rowOf[cell] = static_cast<uint8_t>(row);
+            colOf[cell] = static_cast<uint8_t>(col);
+            boxOf[cell] = static_cast<uint8_t>((row / boxSize) * boxSize + col / boxSize);
+        }
+    }
+
+    void clearBoard() {
+        fill(board, board + cellCount, 0);
+        fill(rowMasks, rowMasks + size, 0);
+        fill(colMasks, colMasks + size, 0);
+        fill(boxMasks, boxMasks + size, 0);
+        steps = 0;
+        stats = SolveStats();
+    }
+
+    // Random diagonal boxes do not always extend to a full grid (small boards
+    // often dead-end), so they are redrawn until one does.
+    void generatePuzzle() {
+        SUDOKU_TRACE_SPAN("generatePuzzle");
+        while (true) {
+            fillDiagonalBoxes();
+            SUDOKU_TRACE_SPAN("solveBoard");
+            if (solveBoard()) {
+                break;
+            }
+            clearBoard();
+        }
+        copy(board, board + cellCount, solution);
+        removeDigits(DEFAULT_DIFFICULTY);
+    }
+
+    void fillDiagonalBoxes() {
+        SUDOKU_TRACE_SPAN("fillDiagonalBoxes");
+        for (int i = 0; i < size; i += boxSize) {
+            fillBox(i, i);
+        }
+    }
+
+    void fillBox(int startRow, int startCol) {
+        iota(digitOrder, digitOrder + size, 1);
+        shuffle(digitOrder, digitOrder + size, rng);
+
+        int index = 0;
+        for (int i = 0; i < boxSize; ++i) {
+            for (int j = 0; j < boxSize; ++j) {
+                place(startRow + i, startCol + j, digitOrder[index++]);
+            }
+        }
+    }
+
+    bool solveBoard() {
+        auto emptyCell = findMostConstrainedCell();
+        if (!emptyCell.has_value()) {
+            return true;
+        }
+
+        auto [cell, candidates] = emptyCell.value();
+        for (; candidates != 0; candidates &= candidates - 1) {
+            place(cell, lowestCandidate(candidates));
+            
+            if (solveBoard()) {
+                return true;
+            }
+            
+            unplace(cell);
+        }
+        
+        return false;
+    }
+
+    // Starts from a full grid, so every puzzle it leaves has that grid as a
+    // solution and a failed alternative search proves it is the only one.
+    void removeDigits(double difficulty) {
+        SUDOKU_TRACE_SPAN("removeDigits");
+        if (find(board, board + cellCount, 0) != board + cellCount) {
+            return;
+        }
+        int cellsToRemove = static_cast<int>(cellCount * difficulty);
+        
+        iota(cellOrder, cellOrder + cellCount, 0);
+        
+        shuffle(cellOrder, cellOrder + cellCount, rng);
+        
+        // A check that runs out of budget costs the whole budget and keeps the
+        // clue. On large boards these become the norm once the grid is sparse,
+        // so a run of them ends removal instead of paying for every cell left.
+        int removed = 0;
+        int inconclusiveRun = 0;
+        for (int i = 0; i < cellCount && removed < cellsToRemove && inconclusiveRun < MAX_INCONCLUSIVE_REMOVALS; ++i) {
+            int cell = cellOrder[i];
+            
+            int num = board[cell];
+            unplace(cell);
+            bool exhausted = false;
+            if (hasAlternativeSolution(cell, num, exhausted)) {
+                place(cell, num);
+            } else {
+                ++removed;
+            }
+            inconclusiveRun = exhausted ? inconclusiveRun + 1 : 0;
+        }
+    }
+
+    bool hasAlternativeSolution(int cell, int removedNum, bool& exhausted) {
+        CandidateMask alternatives = getCandidates(cell) & ~bitFor(removedNum);
+        long long nodeBudget = UNIQUENESS_NODE_BUDGET;
+        for (; alternatives != 0; alternatives &= alternatives - 1) {
+            place(cell, lowestCandidate(alternatives));
+            auto acceptAny = [](const uint8_t*) { return true; };
+            bool isSolvable = visitSolutions(1, nodeBudget, acceptAny) > 0;
+            unplace(cell);
+            if (nodeBudget < 0) {
+                exhausted = true;
+                return true;
+            }
+            if (isSolvable) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Running out of budget stops the search as if the limit had been reached,
+    // so the generator only removes a clue once uniqueness has been proven.
+    template <typename Visitor>
+    long long visitSolutions(long long limit, long long& nodeBudget, Visitor& onSolution) {
+        if (--nodeBudget < 0) {
+            return limit;
+        }
+        
+        auto emptyCell = findMostConstrainedCell();
+        if (!emptyCell.has_value()) {
+            return onSolution(board) ? 1 : limit;
+        }
+        
+        auto [cell, candidates] = emptyCell.value();
+        long long count = 0;
+        for (; candidates != 0 && count < limit; candidates &= candidates - 1) {
+            place(cell, lowestCandidate(candidates));
+            count += visitSolutions(limit - count, nodeBudget, onSolution);
+            unplace(cell);
+        }
+        return count;
+    }
+};
+
+void showStep(const Sudoku& sudoku, const function<void()>& displayFunction, int delayMs) {
+    if (displayFunction) {
+        displayFunction();
+        if (sudoku.isPaced()) {
+            this_thread::sleep_for(chrono::milliseconds(delayMs));
+        }
+    }
+}
+
+bool bruteForceSolver(Sudoku& sudoku, function<void()> displayFunction) {
+    struct Frame {
+        int cell;
+        int nextCandidate;
+    };
+    
+    thread_local vector<Frame> stack;
+    stack.resize(sudoku.getCellCount());
+    
+    int frameCount = 0;
+    for (int cell = 0; cell < sudoku.getCellCount(); ++cell) {
+        if (sudoku.getCells()[cell] == 0) {
+            stack[frameCount++] = {cell, 1};
+        }
+    }
+    
+    int size = sudoku.getSize();
+    int depth = 0;
+    sudoku.getSteps()++;
+    
+    while (depth < frameCount) {
+        if (sudoku.searchExpired()) {
+            for (int i = depth; i >= 0; --i) {
+                if (sudoku.getCells()[stack[i].cell] != 0) {
+                    sudoku.unplace(stack[i].cell);
+                }
+            }
+            return false;
+        }
+        Frame& frame = stack[depth];
+        
+        if (sudoku.getCells()[frame.cell] != 0) {
+            sudoku.unplace(frame.cell);
+            SUDOKU_STAT(sudoku.getStats().backtracks++);
+            showStep(sudoku, displayFunction, Sudoku::BACKTRACK_DELAY_MS);
+        }
+        
+        int num = frame.nextCandidate;
+        while (num <= size && !sudoku.isValidPlacement(frame.cell, num)) {
+            ++num;
+        }
+        
+        if (num > size) {
+            if (depth == 0) {
+                return false;
+            }
+            --depth;
+            continue;
+        }
+        
+        sudoku.place(frame.cell, num);
+        SUDOKU_STAT(sudoku.getStats().guesses++);
+        SUDOKU_STAT(sudoku.getStats().noteDepth(depth + 1));
+        showStep(sudoku, displayFunction, Sudoku::VISUALIZATION_DELAY_MS);
+        frame.nextCandidate = num + 1;
+        
+        if (++depth < frameCount) {
+            stack[depth].nextCandidate = 1;
+        }
+        sudoku.getSteps()++;
+    }
+    
+    return true;
+}
+
+class DancingLinks {
+private:
+    static constexpr int CONSTRAINT_KINDS = 4;
+
+    struct Node {
+        int left;
+        int right;
+        int up;
+        int down;
+        int column;
+    };
+
+    int size;
+    int boxSize;
+    int columnCount;
+    vector<Node> nodes;
+    vector<int> columnSizes;
+    vector<int> givenRows;
+
+public:
+    DancingLinks(int boardSize, int boxWidth)
+        : size(boardSize), boxSize(boxWidth), columnCount(CONSTRAINT_KINDS * boardSize * boardSize),
+          nodes(1 + columnCount + CONSTRAINT_KINDS * boardSize * boardSize * boardSize),
+          columnSizes(1 + columnCount, 0) {
+        givenRows.reserve(size * size);
+        buildMatrix();
+    }
+
+    int getSize() const { return size; }
+
+    bool solve(Sudoku& sudoku, const function<void()>& displayFunction) {
+        givenRows.clear();
+        for (int cell = 0; cell < size * size; ++cell) {
+            int num = sudoku.getCells()[cell];
+            if (num != 0) {
+                int row = cell * size + num - 1;
+                if (!isRowAvailable(row)) {
+                    unselectGivens();
+                    return false;
+                }
+                selectRow(firstNodeOf(row));
+                givenRows.push_back(row);
+            }
+        }
+        
+        bool isSolved = search(sudoku, displayFunction, 0);
+        unselectGivens();
+        return isSolved;
+    }
+
+private:
+    int firstNodeOf(int row) const {
+        return 1 + columnCount + CONSTRAINT_KINDS * row;
+    }
+
+    int rowOfNode(int node) const {
+        return (node - 1 - columnCount) / CONSTRAINT_KINDS;
+    }
+
+    void buildMatrix() {
+        for (int column = 0; column <= columnCount; ++column) {
+            nodes[column] = {column - 1, column + 1, column, column, column};
+        }
+        nodes[0].left = columnCount;
+        nodes[columnCount].right = 0;
+        
+        int cellCount = size * size;
+        for (int cell = 0; cell < cellCount; ++cell) {
+            int gridRow = cell / size;
+            int gridCol = cell % size;
+            int box = (gridRow / boxSize) * boxSize + gridCol / boxSize;
+            
+            for (int digit = 0; digit < size; ++digit) {
+                int columns[CONSTRAINT_KINDS] = {
+                    1 + cell,
+                    1 + cellCount + gridRow * size + digit,
+                    1 + 2 * cellCount + gridCol * size + digit,
+                    1 + 3 * cellCount + box * size + digit,
+                };
+                
+                int first = firstNodeOf(cell * size + digit);
+                for (int k = 0; k < CONSTRAINT_KINDS; ++k) {
+                    int node = first + k;
+                    int column = columns[k];
+                    nodes[node].left = first + (k + CONSTRAINT_KINDS - 1) % CONSTRAINT_KINDS;
+                    nodes[node].right = first + (k + 1) % CONSTRAINT_KINDS;
+                    nodes[node].column = column;
+                    nodes[node].up = nodes[column].up;
+                    nodes[node].down = column;
+                    nodes[nodes[column].up].down = node;
+                    nodes[column].up = node;
+                    ++columnSizes[column];
+                }
+            }
+        }
+    }
+
+    bool isRowAvailable(int row) const {
+        int first = firstNodeOf(row);
+        for (int k = 0; k < CONSTRAINT_KINDS; ++k) {
+            int column = nodes[first + k].column;
+            if (nodes[nodes[column].left].right != column) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void cover(int column) {
+        nodes[nodes[column].right].left = nodes[column].left;
+        nodes[nodes[column].left].right = nodes[column].right;
+        for (int i = nodes[column].down; i != column; i = nodes[i].down) {
+            for (int j = nodes[i].right; j != i; j = nodes[j].right) {
+                nodes[nodes[j].down].up = nodes[j].up;
+                nodes[nodes[j].up].down = nodes[j].down;
+                --columnSizes[nodes[j].column];
+            }
+        }
+    }
+
+    void uncover(int column) {
+        for (int i = nodes[column].up; i != column; i = nodes[i].up) {
+            for (int j = nodes[i].left; j != i; j = nodes[j].left) {
+                ++columnSizes[nodes[j].column];
+                nodes[nodes[j].down].up = j;
+                nodes[nodes[j].up].down = j;
+            }
+        }
+        nodes[nodes[column].right].left = column;
+        nodes[nodes[column].left].right = column;
+    }
+
+    void selectRow(int node) {
+        cover(nodes[node].column);
+        for (int j = nodes[node].right; j != node; j = nodes[j].right) {
+            cover(nodes[j].column);
+        }
+    }
+
+    void unselectRow(int node) {
+        for (int j = nodes[node].left; j != node; j = nodes[j].left) {
+            uncover(nodes[j].column);
+        }
+        uncover(nodes[node].column);
+    }
+
+    void unselectGivens() {
+        while (!givenRows.empty()) {
+            unselectRow(firstNodeOf(givenRows.back()));
+            givenRows.pop_back();
+        }
+    }
+
+    int chooseColumn() const {
+        int best = nodes[0].right;
+        for (int column = nodes[best].right; column != 0; column = nodes[column].right) {
+            if (columnSizes[column] < columnSizes[best]) {
+                best = column;
+                if (columnSizes[best] <= 1) {
+                    break;
+                }
+            }
+        }
+        return best;
+    }
+
+    bool search(Sudoku& sudoku, const function<void()>& displayFunction, int depth) {
+        sudoku.getSteps()++;
+        SUDOKU_STAT(sudoku.getStats().noteDepth(depth));
+        
+        if (nodes[0].right == 0) {
+            return true;
+        }
+        if (sudoku.searchExpired()) {
+            return false;
+        }
+        
+        int column = chooseColumn();
+        if (columnSizes[column] == 0) {
+            return false;
+        }
+        
+        cover(column);
+        for (int node = nodes[column].down; node != column; node = nodes[node].down) {
+            for (int j = nodes[node].right; j != node; j = nodes[j].right) {
+                cover(nodes[j].column);
+            }
+            
+            int row = rowOfNode(node);
+            sudoku.place(row / size, row % size + 1);
+            SUDOKU_STAT(columnSizes[column] > 1 ? sudoku.getStats().guesses++ : sudoku.getStats().nakedSingles++);
+            showStep(sudoku, displayFunction, Sudoku::VISUALIZATION_DELAY_MS);
+            
+            bool isSolved = search(sudoku, displayFunction, depth + 1);
+            
+            for (int j = nodes[node].left; j != node; j = nodes[j].left) {
+                uncover(nodes[j].column);
+            }
+            
+            if (isSolved) {
+                uncover(column);
+                return true;
+            }
+            
+            sudoku.unplace(row / size);
+            SUDOKU_STAT(sudoku.getStats().backtracks++);
+            showStep(sudoku, displayFunction, Sudoku::BACKTRACK_DELAY_MS);
+            if (sudoku.searchExpired()) {
+                break;
+            }
+        }
+        uncover(column);
+        
+        return false;
+    }
+};
+
+class PropagationSolver {
+private:
+    int size;
+    int unitCount;
+    vector<int> unitCells;
+    vector<int> trail;
+    vector<Sudoku::CandidateMask> candidateMasks;
+
+public:
+    PropagationSolver(int boardSize, int boxWidth)
+        : size(boardSize), unitCount(3 * boardSize), unitCells(3 * boardSize * boardSize),
+          candidateMasks(boardSize * boardSize) {
+        trail.reserve(boardSize * boardSize);
+        for (int i = 0; i < size; ++i) {
+            for (int j = 0; j < size; ++j) {
+                unitCells[i * size + j] = i * size + j;
+                unitCells[(size + i) * size + j] = j * size + i;
+                int boxRow = (i / boxWidth) * boxWidth + j / boxWidth;
+                int boxCol = (i % boxWidth) * boxWidth + j % boxWidth;
+                unitCells[(2 * size + i) * size + j] = boxRow * size + boxCol;
+            }
+        }
+    }
+
+    int getSize() const { return size; }
+
+    bool solve(Sudoku& sudoku, const function<void()>& displayFunction) {
+        trail.clear();
+        return search(sudoku, displayFunction, 0);
+    }
+
+private:
+    void assign(Sudoku& sudoku, int cell, int num, const function<void()>& displayFunction) {
+        sudoku.place(cell, num);
+        trail.push_back(cell);
+        showStep(sudoku, displayFunction, Sudoku::VISUALIZATION_DELAY_MS);
+    }
+
+    void undoTo(Sudoku& sudoku, size_t mark, const function<void()>& displayFunction) {
+        while (trail.size() > mark) {
+            sudoku.unplace(trail.back());
+            trail.pop_back();
+            showStep(sudoku, displayFunction, Sudoku::BACKTRACK_DELAY_MS);
+        }
+    }
+
+    bool propagate(Sudoku& sudoku, const function<void()>& displayFunction) {
+        const uint8_t* cells = sudoku.getCells();
+        bool progress = true;
+        
+        while (progress) {
+            progress = false;
+            SUDOKU_STAT(sudoku.getStats().propagationRounds++);
+            sudoku.computeAllCandidates(candidateMasks.data());
+            
+            for (int cell = 0; cell < size * size; ++cell) {
+                if (cells[cell] != 0 || countCandidates(candidateMasks[cell]) > 1) {
+                    continue;
+                }
+                Sudoku::CandidateMask remaining = progress ? sudoku.getCandidates(cell) : candidateMasks[cell];
+                if (remaining == 0) {
+                    return false;
+                }
+                assign(sudoku, cell, lowestCandidate(remaining), displayFunction);
+                SUDOKU_STAT(sudoku.getStats().nakedSingles++);
+                progress = true;
+            }
+            
+            for (int unit = 0; unit < unitCount; ++unit) {
+                const int* members = &unitCells[unit * size];
+                Sudoku::CandidateMask once = 0;
+                Sudoku::CandidateMask twice = 0;
+                Sudoku::CandidateMask placed = 0;
+                
+                for (int i = 0; i < size; ++i) {
+                    int cell = members[i];
+                    if (cells[cell] != 0) {
+                        placed |= Sudoku::bitFor(cells[cell]);
+                        continue;
+                    }
+                    Sudoku::CandidateMask candidates = sudoku.getCandidates(cell);
+                    twice |= once & candidates;
+                    once |= candidates;
+                }
+                
+                if ((once | placed) != sudoku.getFullMask()) {
+                    return false;
+                }
+                
+                for (Sudoku::CandidateMask hidden = once & ~twice & ~placed; hidden != 0; hidden &= hidden - 1) {
+                    int num = lowestCandidate(hidden);
+                    for (int i = 0; i < size; ++i) {
+                        int cell = members[i];
+                        if (cells[cell] == 0 && (sudoku.getCandidates(cell) & Sudoku::bitFor(num)) != 0) {
+                            assign(sudoku, cell, num, displayFunction);
+                            SUDOKU_STAT(sudoku.getStats().hiddenSingles++);
+                            progress = true;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        
+        return true;
+    }
+
+    int selectMostConstrainedCell(const Sudoku& sudoku) {
+        const uint8_t* cells = sudoku.getCells();
+        int bestCell = -1;
+        int bestCount = size + 1;
+        sudoku.computeAllCandidates(candidateMasks.data());
+        
+        for (int cell = 0; cell < size * size; ++cell) {
+            if (cells[cell] != 0) {
+                continue;
+            }
+            int count = countCandidates(candidateMasks[cell]);
+            if (count < bestCount) {
+                bestCell = cell;
+                bestCount = count;
+                if (count <= 2) {
+                    break;
+                }
+            }
+        }
+        return bestCell;
+    }
+
+    bool search(Sudoku& sudoku, const function<void()>& displayFunction, int depth) {
+        sudoku.getSteps()++;
+        SUDOKU_STAT(sudoku.getStats().noteDepth(depth));
+        if (sudoku.searchExpired()) {
+            return false;
+        }
+        size_t mark = trail.size();
+        
+        if (!propagate(sudoku, displayFunction)) {
+            undoTo(sudoku, mark, displayFunction);
+            return false;
+        }
+        
+        int cell = selectMostConstrainedCell(sudoku);
+        if (cell < 0) {
+            return true;
+        }
+        
+        for (Sudoku::CandidateMask candidates = sudoku.getCandidates(cell); candidates != 0; candidates &= candidates - 1) {
+            size_t branchMark = trail.size();
+            assign(sudoku, cell, lowestCandidate(candidates), displayFunction);
+            SUDOKU_STAT(sudoku.getStats().guesses++);
+            
+            if (search(sudoku, displayFunction, depth + 1)) {
+                return true;
+            }
+            
+            undoTo(sudoku, branchMark, displayFunction);
+            SUDOKU_STAT(sudoku.getStats().backtracks++);
+            if (sudoku.searchExpired()) {
+                break;
+            }
+        }
+        
+        undoTo(sudoku, mark, displayFunction);
+        return false;
+    }
+};
+
+bool propagationSolver(Sudoku& sudoku, function<void()> displayFunction) {
+    thread_local unique_ptr<PropagationSolver> engine;
+    if (!engine || engine->getSize() != sudoku.getSize()) {
+        engine = make_unique<PropagationSolver>(sudoku.getSize(), sudoku.getBoxSize());
+    }
+    return engine->solve(sudoku, displayFunction);
+}
+
+// Solves by a ladder of techniques over its own candidate grid, which unlike
+// the placement masks keeps every elimination: singles, locked candidates
+// (pointing and claiming), naked and hidden pairs and triples, then X-wing.
+// Each rung runs only when the cheaper ones stall, and the search guesses
+// only when the whole ladder stalls.
+class LogicSolver {
+private:
+    using Mask = Sudoku::CandidateMask;
+
+    enum class Outcome {
+        Stalled,
+        Progress,
+        Contradiction
+    };
+
+    static constexpr int MAX_SUBSET = 3;
+
+    int size;
+    int boxSize;
+    int cellCount;
+    int unitCount;
+    int emptyCells = 0;
+    vector<int> unitCells;
+    vector<int> cellUnits;
+    vector<int> trail;
+    vector<Mask> candidates;
+    vector<vector<Mask>> snapshots;
+    vector<uint64_t> positions;
+
+public:
+    LogicSolver(int boardSize, int boxWidth)
+        : size(boardSize), boxSize(boxWidth), cellCount(boardSize * boardSize), unitCount(3 * boardSize),
+          unitCells(3 * boardSize * boardSize), cellUnits(3 * boardSize * boardSize),
+          candidates(boardSize * boardSize), positions(boardSize) {
+        trail.reserve(cellCount);
+        for (int i = 0; i < size; ++i) {
+            for (int j = 0; j < size; ++j) {
+                int boxRow = (i / boxWidth) * boxWidth + j / boxWidth;
+                int boxCol = (i % boxWidth) * boxWidth + j % boxWidth;
+                unitCells[i * size + j] = i * size + j;
+                unitCells[(size + i) * size + j] = j * size + i;
+                unitCells[(2 * size + i) * size + j] = boxRow * size + boxCol;
+                cellUnits[(i * size + j) * 3] = i;
+                cellUnits[(i * size + j) * 3 + 1] = size + j;
+                cellUnits[(boxRow * size + boxCol) * 3 + 2] = 2 * size + i;
+            }
+        }
+    }
+
+    int getSize() const { return size; }
+
+    bool solve(Sudoku& sudoku, const function<void()>& displayFunction) {
+        trail.clear();
+        emptyCells = cellCount;
+        sudoku.computeAllCandidates(candidates.data());
+        const uint8_t* cells = sudoku.getCells();
+        for (int cell = 0; cell < cellCount; ++cell) {
+            if (cells[cell] != 0) {
+                candidates[cell] = 0;
+                --emptyCells;
+            }
+        }
+        return search(sudoku, displayFunction, 0);
+    }
+
+private:
+    void assign(Sudoku& sudoku, int cell, int num, const function<void()>& displayFunction) {
+        Mask bit = Sudoku::bitFor(num);
+        sudoku.place(cell, num);
+        trail.push_back(cell);
+        --emptyCells;
+        candidates[cell] = 0;
+        for (int k = 0; k < 3; ++k) {
+            const int* members = &unitCells[cellUnits[cell * 3 + k] * size];
+            for (int i = 0; i < size; ++i) {
+                candidates[members[i]] &= ~bit;
+            }
+        }
+        showStep(sudoku, displayFunction, Sudoku::VISUALIZATION_DELAY_MS);
+    }
+
+    void undoTo(Sudoku& sudoku, size_t mark, const function<void()>& displayFunction) {
+        while (trail.size() > mark) {
+            sudoku.unplace(trail.back());
+            trail.pop_back();
+            ++emptyCells;
+            showStep(sudoku, displayFunction, Sudoku::BACKTRACK_DELAY_MS);
+        }
+    }
+
+    bool eliminate(int cell, Mask bits) {
+        if ((candidates[cell] & bits) == 0) {
+            return false;
+        }
+        candidates[cell] &= ~bits;
+        return true;
+    }
+
+    Outcome singles(Sudoku& sudoku, const function<void()>& displayFunction) {
+        const uint8_t* cells = sudoku.getCells();
+        Outcome outcome = Outcome::Stalled;
+        
+        for (int cell = 0; cell < cellCount; ++cell) {
+            if (cells[cell] != 0) {
+                continue;
+            }
+            Mask remaining = candidates[cell];
+            if (remaining == 0) {
+                return Outcome::Contradiction;
+            }
+            if ((remaining & (remaining - 1)) == 0) {
+                assign(sudoku, cell, lowestCandidate(remaining), displayFunction);
+                SUDOKU_STAT(sudoku.getStats().nakedSingles++);
+                outcome = Outcome::Progress;
+            }
+        }
+        
+        for (int unit = 0; unit < unitCount; ++unit) {
+            const int* members = &unitCells[unit * size];
+            Mask once = 0;
+            Mask twice = 0;
+            Mask placed = 0;
+            for (int i = 0; i < size; ++i) {
+                int cell = members[i];
+                if (cells[cell] != 0) {
+                    placed |= Sudoku::bitFor(cells[cell]);
+                    continue;
+                }
+                twice |= once & candidates[cell];
+                once |= candidates[cell];
+            }
+            
+            if ((once | placed) != sudoku.getFullMask()) {
+                return Outcome::Contradiction;
+            }
+            
+            for (Mask hidden = once & ~twice & ~placed; hidden != 0; hidden &= hidden - 1) {
+                Mask bit = hidden & (~hidden + 1);
+                for (int i = 0; i < size; ++i) {
+                    if ((candidates[members[i]] & bit) != 0) {
+                        assign(sudoku, members[i], lowestCandidate(bit), displayFunction);
+                        SUDOKU_STAT(sudoku.getStats().hiddenSingles++);
+                        outcome = Outcome::Progress;
+                        break;
+                    }
+                }
+            }
+        }
+        return outcome;
+    }
+
+    // A box and a line crossing it: digits of the intersection seen nowhere
+    // else in the box leave the rest of the line (pointing), and digits seen
+    // nowhere else on the line leave the rest of the box (claiming).
+    Outcome lockedCandidates([[maybe_unused]] Sudoku& sudoku) {
+        Outcome outcome = Outcome::Stalled;
+        for (int box = 0; box < size; ++box) {
+            int firstRow = (box / boxSize) * boxSize;
+            int firstCol = (box % boxSize) * boxSize;
+            for (int line = 0; line < 2 * boxSize; ++line) {
+                bool isRow = line < boxSize;
+                int offset = line % boxSize;
+                auto inBox = [&](int alongLine) {
+                    int first = isRow ? firstCol : firstRow;
+                    return alongLine >= first && alongLine < first + boxSize;
+                };
+                auto lineCell = [&](int alongLine) {
+                    return isRow ? (firstRow + offset) * size + alongLine : alongLine * size + firstCol + offset;
+                };
+                
+                Mask inside = 0;
+                Mask restOfBox = 0;
+                Mask restOfLine = 0;
+                for (int i = 0; i < boxSize; ++i) {
+                    for (int j = 0; j < boxSize; ++j) {
+                        int cell = (firstRow + i) * size + firstCol + j;
+                        ((isRow ? i : j) == offset ? inside : restOfBox) |= candidates[cell];
+                    }
+                }
+                for (int k = 0; k < size; ++k) {
+                    if (!inBox(k)) {
+                        restOfLine |= candidates[lineCell(k)];
+                    }
+                }
+                
+                bool changed = false;
+                if (Mask pointing = inside & ~restOfBox) {
+                    for (int k = 0; k < size; ++k) {
+                        changed |= !inBox(k) && eliminate(lineCell(k), pointing);
+                    }
+                }
+                if (Mask claiming = inside & ~restOfLine) {
+                    for (int i = 0; i < boxSize; ++i) {
+                        for (int j = 0; j < boxSize; ++j) {
+                            if ((isRow ? i : j) != offset) {
+                                changed |= eliminate((firstRow + i) * size + firstCol + j, claiming);
+                            }
+                        }
+                    }
+                }
+                if (changed) {
+                    SUDOKU_STAT(sudoku.getStats().lockedCandidates++);
+                    outcome = Outcome::Progress;
+                }
+            }
+        }
+        return outcome;
+    }
+
+    // Unit positions start..size-1; `chosen` holds the unit positions picked so far.
+    Outcome nakedSubset(const int* members, int subsetSize, int start, int depth, Mask digits, uint64_t chosen) {
+        if (depth == subsetSize) {
+            if (countCandidates(digits) < subsetSize) {
+                return Outcome::Contradiction;
+            }
+            bool changed = false;
+            for (int i = 0; i < size; ++i) {
+                if ((chosen >> i & 1) == 0) {
+                    changed |= eliminate(members[i], digits);
+                }
+            }
+            return changed ? Outcome::Progress : Outcome::Stalled;
+        }
+        for (int i = start; i < size; ++i) {
+            Mask cellDigits = candidates[members[i]];
+            int count = countCandidates(cellDigits);
+            if (count < 2 || count > subsetSize || countCandidates(digits | cellDigits) > subsetSize) {
+                continue;
+            }
+            Outcome outcome = nakedSubset(members, subsetSize, i + 1, depth + 1, digits | cellDigits,
+                                          chosen | uint64_t(1) << i);
+            if (outcome != Outcome::Stalled) {
+                return outcome;
+            }
+        }
+        return Outcome::Stalled;
+    }
+
+    // Digits start..size-1 by their unit positions; `digits` holds those picked so far.
+    Outcome hiddenSubset(const int* members, int subsetSize, int start, int depth, Mask digits, uint64_t cellsUsed) {
+        if (depth == subsetSize) {
+            if (countCandidates(cellsUsed) < subsetSize) {
+                return Outcome::Contradiction;
+            }
+            bool changed = false;
+            for (uint64_t used = cellsUsed; used != 0; used &= used - 1) {
+                changed |= eliminate(members[__builtin_ctzll(used)], ~digits);
+            }
+            return changed ? Outcome::Progress : Outcome::Stalled;
+        }
+        for (int digit = start; digit < size; ++digit) {
+            int count = countCandidates(positions[digit]);
+            if (count < 2 || count > subsetSize || countCandidates(cellsUsed | positions[digit]) > subsetSize) {
+                continue;
+            }
+            Outcome outcome = hiddenSubset(members, subsetSize, digit + 1, depth + 1,
+                                           digits | Mask(1) << digit, cellsUsed | positions[digit]);
+            if (outcome != Outcome::Stalled) {
+                return outcome;
+            }
+        }
+        return Outcome::Stalled;
+    }
+
+    Outcome subsets([[maybe_unused]] Sudoku& sudoku, int subsetSize) {
+        Outcome outcome = Outcome::Stalled;
+        for (int unit = 0; unit < unitCount; ++unit) {
+            const int* members = &unitCells[unit * size];
+            Outcome naked = nakedSubset(members, subsetSize, 0, 0, 0, 0);
+            if (naked == Outcome::Contradiction) {
+                return naked;
+            }
+            if (naked == Outcome::Progress) {
+                SUDOKU_STAT(sudoku.getStats().nakedSubsets++);
+                outcome = naked;
+            }
+            
+            fill(positions.begin(), positions.end(), 0);
+            for (int i = 0; i < size; ++i) {
+                for (Mask digits = candidates[members[i]]; digits != 0; digits &= digits - 1) {
+                    positions[lowestCandidate(digits) - 1] |= uint64_t(1) << i;
+                }
+            }
+            Outcome hidden = hiddenSubset(members, subsetSize, 0, 0, 0, 0);
+            if (hidden == Outcome::Contradiction) {
+                return hidden;
+            }
+            if (hidden == Outcome::Progress) {
+                SUDOKU_STAT(sudoku.getStats().hiddenSubsets++);
+                outcome = hidden;
+            }
+        }
+        return outcome;
+    }
+
+    // Two rows holding a digit in the same two columns only (or the transpose)
+    // remove it from the rest of those columns.
+    Outcome xWing([[maybe_unused]] Sudoku& sudoku) {
+        Outcome outcome = Outcome::Stalled;
+        for (int digit = 0; digit < size; ++digit) {
+            Mask bit = Mask(1) << digit;
+            for (int byRows = 0; byRows < 2; ++byRows) {
+                auto cellAt = [&](int base, int cover) { return byRows ? base * size + cover : cover * size + base; };
+                for (int base = 0; base < size; ++base) {
+                    positions[base] = 0;
+                    for (int cover = 0; cover < size; ++cover) {
+                        if ((candidates[cellAt(base, cover)] & bit) != 0) {
+                            positions[base] |= uint64_t(1) << cover;
+                        }
+                    }
+                }
+                for (int first = 0; first < size; ++first) {
+                    if (countCandidates(positions[first]) != 2) {
+                        continue;
+                    }
+                    for (int second = first + 1; second < size; ++second) {
+                        if (positions[second] != positions[first]) {
+                            continue;
+                        }
+                        bool changed = false;
+                        for (uint64_t covers = positions[first]; covers != 0; covers &= covers - 1) {
+                            int cover = __builtin_ctzll(covers);
+                            for (int base = 0; base < size; ++base) {
+                                if (base != first && base != second && eliminate(cellAt(base, cover), bit)) {
+                                    positions[base] &= ~(uint64_t(1) << cover);
+                                    changed = true;
+                                }
+                            }
+                        }
+                        if (changed) {
+                            SUDOKU_STAT(sudoku.getStats().xWings++);
+                            outcome = Outcome::Progress;
+                        }
+                    }
+                }
+            }
+        }
+        return outcome;
+    }
+
+    bool runLadder(Sudoku& sudoku, const function<void()>& displayFunction) {
+        while (true) {
+            SUDOKU_STAT(sudoku.getStats().propagationRounds++);
+            Outcome outcome = singles(sudoku, displayFunction);
+            if (outcome == Outcome::Stalled && emptyCells == 0) {
+                return true;
+            }
+            if (outcome == Outcome::Stalled) {
+                outcome = lockedCandidates(sudoku);
+            }
+            for (int subsetSize = 2; subsetSize <= MAX_SUBSET && outcome == Outcome::Stalled; ++subsetSize) {
+                outcome = subsets(sudoku, subsetSize);
+            }
+            if (outcome == Outcome::Stalled) {
+                outcome = xWing(sudoku);
+            }
+            if (outcome != Outcome::Progress) {
+                return outcome == Outcome::Stalled;
+            }
+        }
+    }
+
+    int selectMostConstrainedCell(const Sudoku& sudoku) const {
+        const uint8_t* cells = sudoku.getCells();
+        int bestCell = -1;
+        int bestCount = size + 1;
+        for (int cell = 0; cell < cellCount; ++cell) {
+            if (cells[cell] != 0) {
+                continue;
+            }
+            int count = countCandidates(candidates[cell]);
+            if (count < bestCount) {
+                bestCell = cell;
+                bestCount = count;
+                if (count <= 2) {
+                    break;
+                }
+            }
+        }
+        return bestCell;
+    }
+
+    bool search(Sudoku& sudoku, const function<void()>& displayFunction, int depth) {
+        sudoku.getSteps()++;
+        SUDOKU_STAT(sudoku.getStats().noteDepth(depth));
+        if (sudoku.searchExpired()) {
+            return false;
+        }
+        size_t mark = trail.size();
+        
+        if (!runLadder(sudoku, displayFunction)) {
+            undoTo(sudoku, mark, displayFunction);
+            return false;
+        }
+        
+        int cell = selectMostConstrainedCell(sudoku);
+        if (cell < 0) {
+            return true;
+        }
+        
+        if (snapshots.size() <= static_cast<size_t>(depth)) {
+            snapshots.resize(depth + 1);
+        }
+        snapshots[depth] = candidates;
+        
+        for (Mask options = candidates[cell]; options != 0; options &= options - 1) {
+            size_t branchMark = trail.size();
+            assign(sudoku, cell, lowestCandidate(options), displayFunction);
+            SUDOKU_STAT(sudoku.getStats().guesses++);
+            
+            if (search(sudoku, displayFunction, depth + 1)) {
+                return true;
+            }
+            
+            undoTo(sudoku, branchMark, displayFunction);
+            candidates = snapshots[depth];
+            SUDOKU_STAT(sudoku.getStats().backtracks++);
+            if (sudoku.searchExpired()) {
+                break;
+            }
+        }
+        
+        undoTo(sudoku, mark, displayFunction);
+        return false;
+    }
+};
+
+bool logicSolver(Sudoku& sudoku, function<void()> displayFunction) {
+    thread_local unique_ptr<LogicSolver> engine;
+    if (!engine || engine->getSize() != sudoku.getSize()) {
+        engine = make_unique<LogicSolver>(sudoku.getSize(), sudoku.getBoxSize());
+    }
+    return engine->solve(sudoku, displayFunction);
+}
+
+constexpr int boxWidthFor(int boardSize) {
+    int width = 0;
+    while ((width + 1) * (width + 1) <= boardSize) {
+        ++width;
+    }
+    return width;
+}
+
+template <int N>
+struct FixedGeometry {
+    static constexpr int BOX = boxWidthFor(N);
+    static constexpr int CELLS = N * N;
+    static constexpr int UNITS = 3 * N;
+
+    static_assert(BOX * BOX == N, "Board size must be a perfect square");
+
+    using Mask = conditional_t<(N <= 16), uint16_t, conditional_t<(N <= 32), uint32_t, uint64_t>>;
+    using CellIndex = conditional_t<(CELLS <= 256), uint8_t, uint16_t>;
+
+    static constexpr Mask FULL = static_cast<Mask>((uint64_t(1) << N) - 1);
+
+    static constexpr array<uint8_t, CELLS> makeRowTable() {
+        array<uint8_t, CELLS> table{};
+        for (int cell = 0; cell < CELLS; ++cell) {
+            table[cell] = static_cast<uint8_t>(cell / N);
+        }
+        return table;
+    }
+
+    static constexpr array<uint8_t, CELLS> makeColTable() {
+        array<uint8_t, CELLS> table{};
+        for (int cell = 0; cell < CELLS; ++cell) {
+            table[cell] = static_cast<uint8_t>(cell % N);
+        }
+        return table;
+    }
+
+    static constexpr array<uint8_t, CELLS> makeBoxTable() {
+        array<uint8_t, CELLS> table{};
+        for (int cell = 0; cell < CELLS; ++cell) {
+            table[cell] = static_cast<uint8_t>((cell / N / BOX) * BOX + (cell % N) / BOX);
+        }
+        return table;
+    }
+
+    static constexpr array<array<CellIndex, N>, UNITS> makeUnitTable() {
+        array<array<CellIndex, N>, UNITS> table{};
+        for (int i = 0; i < N; ++i) {
+            for (int j = 0; j < N; ++j) {
+                int boxRow = (i / BOX) * BOX + j / BOX;
+                int boxCol = (i % BOX) * BOX + j % BOX;
+                table[i][j] = static_cast<CellIndex>(i * N + j);
+                table[N + i][j] = static_cast<CellIndex>(j * N + i);
+                table[2 * N + i][j] = static_cast<CellIndex>(boxRow * N + boxCol);
+            }
+        }
+        return table;
+    }
+
+    static constexpr array<uint8_t, CELLS> rowOf = makeRowTable();
+    static constexpr array<uint8_t, CELLS> colOf = makeColTable();
+    static constexpr array<uint8_t, CELLS> boxOf = makeBoxTable();
+    static constexpr array<array<CellIndex, N>, UNITS> units = makeUnitTable();
+};
+
+template <int N>
+class FixedSizeSolver {
+private:
+    using Geometry = FixedGeometry<N>;
+    using Mask = typename Geometry::Mask;
+    using CellIndex = typename Geometry::CellIndex;
+
+    array<uint8_t, Geometry::CELLS> cells;
+    array<Mask, N> rowMasks;
+    array<Mask, N> colMasks;
+    array<Mask, N> boxMasks;
+    array<CellIndex, Geometry::CELLS> trail;
+    int trailSize;
+    int steps;
+    SolveStats stats;
+    SolveGuard* guard = nullptr;
+
+public:
+    bool load(const uint8_t* source) {
+        rowMasks.fill(0);
+        colMasks.fill(0);
+        boxMasks.fill(0);
+        cells.fill(0);
+        trailSize = 0;
+        steps = 0;
+        stats = SolveStats();
+        
+        for (int cell = 0; cell < Geometry::CELLS; ++cell) {
+            int num = source[cell];
+            if (num == 0) {
+                continue;
+            }
+            if ((candidatesOf(cell) & bit(num)) == 0) {
+                return false;
+            }
+            place(cell, num);
+        }
+        trailSize = 0;
+        return true;
+    }
+
+    bool solve(SolveGuard& solveGuard) {
+        guard = &solveGuard;
+        return search(0);
+    }
+
+    const uint8_t* getCells() const { return cells.data(); }
+    int getSteps() const { return steps; }
+    const SolveStats& getStats() const { return stats; }
+
+private:
+    static Mask bit(int num) {
+        return static_cast<Mask>(Mask(1) << (num - 1));
+    }
+
+    Mask candidatesOf(int cell) const {
+        return static_cast<Mask>(~(rowMasks[Geometry::rowOf[cell]] | colMasks[Geometry::colOf[cell]] |
+                                   boxMasks[Geometry::boxOf[cell]]) & Geometry::FULL);
+    }
+
+    void place(int cell, int num) {
+        Mask value = bit(num);
+        cells[cell] = static_cast<uint8_t>(num);
+        rowMasks[Geometry::rowOf[cell]] |= value;
+        colMasks[Geometry::colOf[cell]] |= value;
+        boxMasks[Geometry::boxOf[cell]] |= value;
+        trail[trailSize++] = static_cast<CellIndex>(cell);
+    }
+
+    void undoTo(int mark) {
+        while (trailSize > mark) {
+            int cell = trail[--trailSize];
+            Mask value = static_cast<Mask>(~bit(cells[cell]));
+            cells[cell] = 0;
+            rowMasks[Geometry::rowOf[cell]] &= value;
+            colMasks[Geometry::colOf[cell]] &= value;
+            boxMasks[Geometry::boxOf[cell]] &= value;
+        }
+    }
+
+    bool propagate() {
+        bool progress = true;
+        
+        while (progress) {
+            progress = false;
+            SUDOKU_STAT(stats.propagationRounds++);
+            
+            for (int cell = 0; cell < Geometry::CELLS; ++cell) {
+                if (cells[cell] != 0) {
+                    continue;
+                }
+                Mask candidates = candidatesOf(cell);
+                if (candidates == 0) {
+                    return false;
+                }
+                if ((candidates & (candidates - 1)) == 0) {
+                    place(cell, lowestCandidate(candidates));
+                    SUDOKU_STAT(stats.nakedSingles++);
+                    progress = true;
+                }
+            }
+            
+            for (const auto& members : Geometry::units) {
+                Mask once = 0;
+                Mask twice = 0;
+                Mask placed = 0;
+                
+                for (int cell : members) {
+                    if (cells[cell] != 0) {
+                        placed |= bit(cells[cell]);
+                        continue;
+                    }
+                    Mask candidates = candidatesOf(cell);
+                    twice |= once & candidates;
+                    once |= candidates;
+                }
+                
+                if ((once | placed) != Geometry::FULL) {
+                    return false;
+                }
+                
+                for (Mask hidden = once & ~twice & ~placed; hidden != 0; hidden &= hidden - 1) {
+                    int num = lowestCandidate(hidden);
+                    for (int cell : members) {
+                        if (cells[cell] == 0 && (candidatesOf(cell) & bit(num)) != 0) {
+                            place(cell, num);
+                            SUDOKU_STAT(stats.hiddenSingles++);
+                            progress = true;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        
+        return true;
+    }
+
+    int selectMostConstrainedCell() const {
+        int bestCell = -1;
+        int bestCount = N + 1;
+        
+        for (int cell = 0; cell < Geometry::CELLS; ++cell) {
+            if (cells[cell] != 0) {
+                continue;
+            }
+            int count = countCandidates(candidatesOf(cell));
+            if (count < bestCount) {
+                bestCell = cell;
+                bestCount = count;
+                if (count <= 2) {
+                    break;
+                }
+            }
+        }
+        return bestCell;
+    }
+
+    bool search(int depth) {
+        ++steps;
+        SUDOKU_STAT(stats.noteDepth(depth));
+        if (guard->expired(steps)) {
+            return false;
+        }
+        int mark = trailSize;
+        
+        if (!propagate()) {
+            undoTo(mark);
+            return false;
+        }
+        
+        int cell = selectMostConstrainedCell();
+        if (cell < 0) {
+            return true;
+        }
+        
+        for (Mask candidates = candidatesOf(cell); candidates != 0; candidates &= candidates - 1) {
+            int branchMark = trailSize;
+            place(cell, lowestCandidate(candidates));
+            SUDOKU_STAT(stats.guesses++);
+            
+            if (search(depth + 1)) {
+                return true;
+            }
+            
+            undoTo(branchMark);
+            SUDOKU_STAT(stats.backtracks++);
+            if (guard->expired(steps)) {
+                break;
+            }
+        }
+        
+        undoTo(mark);
+        return false;
+    }
+};
+
+template <int N>
+bool solveFixedSize(Sudoku& sudoku) {
+    thread_local FixedSizeSolver<N> engine;
+    if (!engine.load(sudoku.getCells())) {
+        return false;
+    }
+    
+    bool isSolved = engine.solve(sudoku.getGuard());
+    sudoku.getSteps() += engine.getSteps();
+    SUDOKU_STAT(sudoku.getStats() += engine.getStats());
+    
+    if (isSolved) {
+        sudoku.fillFrom(engine.getCells());
+    }
+    return isSolved;
+}
+
+bool specializedSolver(Sudoku& sudoku, function<void()> displayFunction) {
+    if (displayFunction) {
+        return propagationSolver(sudoku, displayFunction);
+    }
+    
+    switch (sudoku.getSize()) {
+        case 4:
+            return solveFixedSize<4>(sudoku);
+        case 9:
+            return solveFixedSize<9>(sudoku);
+        case 16:
+            return solveFixedSize<16>(sudoku);
+        case 25:
+            return solveFixedSize<25>(sudoku);
+        case 36:
+            return solveFixedSize<36>(sudoku);
+        default:
+            return propagationSolver(sudoku, displayFunction);
+    }
+}
+
+enum class KernelResult : uint8_t {
+    Unsolvable,
+    Solved,
+    Aborted,
+    Stalled
+};
+
+// Data-parallel batch kernel in the shape of a GPU one: every lane owns one
+// puzzle and the candidate grid is stored lane-minor (cell-major, lanes
+// contiguous), so propagation runs the same branch-free bitmask step over all
+// lanes at once and the compiler maps the lane loops onto vector registers.
+// Lanes that stall branch, backtrack and refill from the queue on their own;
+// the lockstep propagation simply idles lanes that have already converged. A
+// lane still searching after STALL_STEPS branches gives its board back as
+// Stalled, since deep searches run faster on the scalar fixed engine.
+template <int N>
+class LaneSolver {
+public:
+    static constexpr int LANES = 16;
+    static constexpr int STALL_STEPS = 16;
+
+private:
+    using Geometry = FixedGeometry<N>;
+    using Mask = typename Geometry::Mask;
+
+    static constexpr int CELLS = Geometry::CELLS;
+    static constexpr int PEERS = 3 * (N - 1) - 2 * (Geometry::BOX - 1);
+
+    struct Lane {
+        long long board = -1;
+        int depth = 0;
+        int steps = 0;
+        array<uint8_t, CELLS> branchCell;
+        array<Mask, CELLS> untried;
+    };
+
+    alignas(64) Mask candidates[CELLS][LANES];
+    alignas(64) Mask previous[CELLS][LANES];
+    array<array<uint8_t, PEERS>, CELLS> peers;
+    array<Lane, LANES> lanes;
+    vector<Mask> snapshots;
+
+public:
+    LaneSolver() : snapshots(static_cast<size_t>(LANES) * CELLS * CELLS) {
+        for (int cell = 0; cell < CELLS; ++cell) {
+            int count = 0;
+            for (int other = 0; other < CELLS; ++other) {
+                if (other != cell && (Geometry::rowOf[other] == Geometry::rowOf[cell] ||
+                                      Geometry::colOf[other] == Geometry::colOf[cell] ||
+                                      Geometry::boxOf[other] == Geometry::boxOf[cell])) {
+                    peers[cell][count++] = static_cast<uint8_t>(other);
+                }
+            }
+        }
+    }
+
+    // Solves count boards of N*N values (0 = empty) in place. The guard, if
+    // any, is charged with every lane's branches and aborts the whole call.
+    void solve(uint8_t* boards, size_t count, KernelResult* results, SolveGuard* guard = nullptr, int* steps = nullptr) {
+        size_t next = 0;
+        int active = 0;
+        for (int lane = 0; lane < LANES; ++lane) {
+            lanes[lane].board = -1;
+            active += refill(lane, boards, count, next);
+        }
+        
+        while (active > 0) {
+            array<bool, LANES> broken = propagate();
+            for (int lane = 0; lane < LANES; ++lane) {
+                Lane& state = lanes[lane];
+                if (state.board < 0) {
+                    continue;
+                }
+                optional<KernelResult> outcome = broken[lane] ? backtrack(lane) : branchOrFinish(lane);
+                if (!outcome.has_value() && state.steps >= STALL_STEPS) {
+                    outcome = KernelResult::Stalled;
+                }
+                if (!outcome.has_value()) {
+                    continue;
+                }
+                uint8_t* board = boards + state.board * CELLS;
+                if (outcome.value() == KernelResult::Solved) {
+                    for (int cell = 0; cell < CELLS; ++cell) {
+                        board[cell] = static_cast<uint8_t>(lowestCandidate(candidates[cell][lane]));
+                    }
+                }
+                results[state.board] = outcome.value();
+                if (steps != nullptr) {
+                    *steps += state.steps;
+                }
+                state.board = -1;
+                active -= 1 - refill(lane, boards, count, next);
+            }
+            
+            if (guard != nullptr && guard->expired(steps != nullptr ? *steps + inFlightSteps() : 0)) {
+                for (Lane& state : lanes) {
+                    if (state.board >= 0) {
+                        results[state.board] = KernelResult::Aborted;
+                        state.board = -1;
+                    }
+                }
+                for (; next < count; ++next) {
+                    results[next] = KernelResult::Aborted;
+                }
+                return;
+            }
+        }
+    }
+
+private:
+    int inFlightSteps() const {
+        int total = 0;
+        for (const Lane& state : lanes) {
+            total += state.board >= 0 ? state.steps : 0;
+        }
+        return total;
+    }
+
+    // Loads the next queued board into the lane; a lane left idle is zeroed,
+    // which propagation leaves untouched.
+    int refill(int lane, const uint8_t* boards, size_t count, size_t& next) {
+        Lane& state = lanes[lane];
+        state.depth = 0;
+        state.steps = 0;
+        if (next == count) {
+            for (int cell = 0; cell < CELLS; ++cell) {
+                candidates[cell][lane] = 0;
+            }
+            return 0;
+        }
+        state.board = static_cast<long long>(next);
+        const uint8_t* board = boards + next++ * CELLS;
+        for (int cell = 0; cell < CELLS; ++cell) {
+            candidates[cell][lane] = board[cell] == 0 ? Geometry::FULL : static_cast<Mask>(Mask(1) << (board[cell] - 1));
+        }
+        return 1;
+    }
+
+    // Naked singles clear their digit from every peer and hidden singles
+    // collapse their cell, repeated until no lane changes. A lane breaks when
+    // a cell runs out of candidates or a unit loses a digit.
+    array<bool, LANES> propagate() {
+        array<bool, LANES> broken{};
+        while (true) {
+            memcpy(previous, candidates, sizeof(candidates));
+            
+            for (int cell = 0; cell < CELLS; ++cell) {
+                Mask single[LANES];
+                for (int lane = 0; lane < LANES; ++lane) {
+                    Mask value = candidates[cell][lane];
+                    single[lane] = (value & (value - 1)) == 0 ? value : 0;
+                }
+                for (int peer : peers[cell]) {
+                    for (int lane = 0; lane < LANES; ++lane) {
+                        candidates[peer][lane] &= static_cast<Mask>(~single[lane]);
+                    }
+                }
+            }
+            
+            for (const auto& unit : Geometry::units) {
+                Mask once[LANES] = {};
+                Mask twice[LANES] = {};
+                for (int cell : unit) {
+                    for (int lane = 0; lane < LANES; ++lane) {
+                        twice[lane] |= once[lane] & candidates[cell][lane];
+                        once[lane] |= candidates[cell][lane];
+                    }
+                }
+                for (int lane = 0; lane < LANES; ++lane) {
+                    broken[lane] |= once[lane] != Geometry::FULL;
+                    once[lane] &= static_cast<Mask>(~twice[lane]);
+                }
+                for (int cell : unit) {
+                    for (int lane = 0; lane < LANES; ++lane) {
+                        Mask hidden = candidates[cell][lane] & once[lane];
+                        candidates[cell][lane] = hidden != 0 ? hidden : candidates[cell][lane];
+                    }
+                }
+            }
+            
+            Mask changed[LANES] = {};
+            for (int cell = 0; cell < CELLS; ++cell) {
+                for (int lane = 0; lane < LANES; ++lane) {
+                    changed[lane] |= candidates[cell][lane] ^ previous[cell][lane];
+                    broken[lane] |= candidates[cell][lane] == 0;
+                }
+            }
+            bool progress = false;
+            for (int lane = 0; lane < LANES; ++lane) {
+                progress |= changed[lane] != 0 && !broken[lane];
+            }
+            if (!progress) {
+                return broken;
+            }
+        }
+    }
+
+    Mask* snapshot(int lane, int depth) {
+        return snapshots.data() + (static_cast<size_t>(lane) * CELLS + depth) * CELLS;
+    }
+
+    optional<KernelResult> branchOrFinish(int lane) {
+        Lane& state = lanes[lane];
+        int bestCell = -1;
+        int bestCount = N + 1;
+        for (int cell = 0; cell < CELLS; ++cell) {
+            int count = countCandidates(candidates[cell][lane]);
+            if (count > 1 && count < bestCount) {
+                bestCell = cell;
+                bestCount = count;
+            }
+        }
+        if (bestCell < 0) {
+            return KernelResult::Solved;
+        }
+        
+        Mask* saved = snapshot(lane, state.depth);
+        for (int cell = 0; cell < CELLS; ++cell) {
+            saved[cell] = candidates[cell][lane];
+        }
+        Mask options = candidates[bestCell][lane];
+        state.branchCell[state.depth] = static_cast<uint8_t>(bestCell);
+        state.untried[state.depth] = options & (options - 1);
+        candidates[bestCell][lane] = options & static_cast<Mask>(~(options & (options - 1)));
+        ++state.depth;
+        ++state.steps;
+        return nullopt;
+    }
+
+    optional<KernelResult> backtrack(int lane) {
+        Lane& state = lanes[lane];
+        while (state.depth > 0) {
+            int depth = state.depth - 1;
+            Mask options = state.untried[depth];
+            if (options == 0) {
+                --state.depth;
+                continue;
+            }
+            const Mask* saved = snapshot(lane, depth);
+            for (int cell = 0; cell < CELLS; ++cell) {
+                candidates[cell][lane] = saved[cell];
+            }
+            state.untried[depth] = options & (options - 1);
+            candidates[state.branchCell[depth]][lane] = options & static_cast<Mask>(~(options & (options - 1)));
+            ++state.steps;
+            return nullopt;
+        }
+        return KernelResult::Unsolvable;
+    }
+};
+
+bool laneSolver(Sudoku& sudoku, function<void()> displayFunction) {
+    if (displayFunction || sudoku.getSize() != 9) {
+        return specializedSolver(sudoku, displayFunction);
+    }
+    
+    thread_local unique_ptr<LaneSolver<9>> kernel;
+    if (!kernel) {
+        kernel = make_unique<LaneSolver<9>>();
+    }
+    uint8_t board[81];
+    memcpy(board, sudoku.getCells(), sizeof(board));
+    KernelResult result = KernelResult::Unsolvable;
+    kernel->solve(board, 1, &result, &sudoku.getGuard(), &sudoku.getSteps());
+    if (result == KernelResult::Stalled) {
+        return specializedSolver(sudoku, displayFunction);
+    }
+    if (result != KernelResult::Solved) {
+        return false;
+    }
+    sudoku.fillFrom(board);
+    return true;
+}
+
+// Batch backends take a whole block of boards of one size (N*N values each)
+// and solve them in place with a result per board. They are looked up by
+// solver name next to the per-puzzle engines.
+using BatchKernel = function<void(uint8_t*, size_t, KernelResult*)>;
+
+struct BatchBackend {
+    int boardSize;
+    BatchKernel kernel;
+};
+
+optional<BatchBackend> findBatchBackend(const string& name) {
+    if (name == "lanes") {
+        return BatchBackend{9, [](uint8_t* boards, size_t count, KernelResult* results) {
+            thread_local unique_ptr<LaneSolver<9>> kernel;
+            if (!kernel) {
+                kernel = make_unique<LaneSolver<9>>();
+            }
+            kernel->solve(boards, count, results);
+        }};
+    }
+    return nullopt;
+}
+
+bool dancingLinksSolver(Sudoku& sudoku, function<void()> displayFunction) {
+    thread_local unique_ptr<DancingLinks> matrix;
+    if (!matrix || matrix->getSize() != sudoku.getSize()) {
+        matrix = make_unique<DancingLinks>(sudoku.getSize(), sudoku.getBoxSize());
+    }
+    return matrix->solve(sudoku, displayFunction);
+}
+
+const char* gradeDifficulty(const SolveStats& stats) {
+    bool needsAdvancedLogic = stats.lockedCandidates + stats.nakedSubsets + stats.hiddenSubsets + stats.xWings > 0;
+    if (stats.guesses == 0 && stats.hiddenSingles == 0 && !needsAdvancedLogic) {
+        return "easy";
+    }
+    if (stats.guesses == 0 && !needsAdvancedLogic) {
+        return "medium";
+    }
+    if (stats.guesses <= 5) {
+        return "hard";
+    }
+    return "expert";
+}
+
+// Races several engines on copies of one board, one persistent thread per
+// engine. The first engine to solve, or to exhaust its search and so prove
+// there is no solution, cancels the others through a shared token; losers stop
+// within one guard poll interval.
+class PortfolioRacer {
+private:
+    struct Racer {
+        SolverFunction engine;
+        optional<Sudoku> board;
+        SolveResult result{false, 0};
+    };
+
+    vector<Racer> racers;
+    vector<thread> workers;
+    mutex raceMutex;
+    condition_variable jobReady;
+    condition_variable raceDone;
+    const Sudoku* source = nullptr;
+    SolveLimits raceLimits;
+    CancellationToken token;
+    uint64_t generation = 0;
+    size_t started = 0;
+    size_t finished = 0;
+    int winner = -1;
+    bool unsolvable = false;
+    bool shuttingDown = false;
+
+public:
+    explicit PortfolioRacer(const vector<SolverFunction>& engines) : racers(engines.size()) {
+        for (size_t i = 0; i < engines.size(); ++i) {
+            racers[i].engine = engines[i];
+        }
+        started = finished = racers.size();
+        for (size_t i = 0; i < racers.size(); ++i) {
+            workers.emplace_back([this, i]() { runRacer(i); });
+        }
+    }
+
+    ~PortfolioRacer() {
+        {
+            lock_guard<mutex> lock(raceMutex);
+            shuttingDown = true;
+            token.cancel();
+        }
+        jobReady.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    bool race(Sudoku& sudoku) {
+        unique_lock<mutex> lock(raceMutex);
+        raceDone.wait(lock, [this]() { return finished == racers.size(); });
+        
+        const CancellationToken* outer = sudoku.getGuard().getLimits().cancellation;
+        source = &sudoku;
+        raceLimits = sudoku.getGuard().getLimits();
+        raceLimits.cancellation = &token;
+        token.reset();
+        winner = -1;
+        unsolvable = false;
+        started = 0;
+        finished = 0;
+        ++generation;
+        jobReady.notify_all();
+        
+        // Every racer must have copied the board before it may be modified.
+        auto settled = [this]() {
+            return started == racers.size() && (winner >= 0 || unsolvable || finished == racers.size());
+        };
+        while (!settled()) {
+            if (outer == nullptr) {
+                raceDone.wait(lock, settled);
+            } else if (!raceDone.wait_for(lock, chrono::milliseconds(1), settled) && outer->isCancelled()) {
+                token.cancel();
+            }
+        }
+        
+        if (winner >= 0) {
+            const Sudoku& solved = racers[winner].board.value();
+            sudoku.fillFrom(solved.getCells());
+            sudoku.getSteps() += racers[winner].result.steps;
+            SUDOKU_STAT(sudoku.getStats() += solved.getStats());
+            return true;
+        }
+        if (unsolvable) {
+            return false;
+        }
+        for (const Racer& racer : racers) {
+            if (racer.result.abortReason != AbortReason::None) {
+                sudoku.getGuard().abort(racer.result.abortReason);
+                break;
+            }
+        }
+        return false;
+    }
+
+private:
+    void runRacer(size_t index) {
+        Racer& racer = racers[index];
+        uint64_t seen = 0;
+        unique_lock<mutex> lock(raceMutex);
+        while (true) {
+            jobReady.wait(lock, [this, seen]() { return shuttingDown || generation != seen; });
+            if (shuttingDown) {
+                return;
+            }
+            seen = generation;
+            racer.board = *source;
+            racer.board->setSolver(racer.engine);
+            racer.board->setLimits(raceLimits);
+            ++started;
+            raceDone.notify_all();
+            lock.unlock();
+            
+            SolveResult result = racer.board->solveHeadless();
+            
+            lock.lock();
+            racer.result = result;
+            if (winner < 0 && !unsolvable) {
+                if (result.solved) {
+                    winner = static_cast<int>(index);
+                    token.cancel();
+                } else if (result.abortReason == AbortReason::None) {
+                    unsolvable = true;
+                    token.cancel();
+                }
+            }
+            ++finished;
+            raceDone.notify_all();
+        }
+    }
+};
+
+bool portfolioSolver(Sudoku& sudoku, function<void()> displayFunction) {
+    if (displayFunction) {
+        return propagationSolver(sudoku, displayFunction);
+    }
+    
+    thread_local unique_ptr<PortfolioRacer> racer;
+    if (!racer) {
+        racer = make_unique<PortfolioRacer>(vector<SolverFunction>{
+            specializedSolver, dancingLinksSolver, bruteForceSolver});
+    }
+    return racer->race(sudoku);
+}
+
+// Subtrees handed to the pool per worker thread, so stealing can even out
+// uneven subtrees, and a cap on the board copies held for one solve.
+constexpr size_t PARALLEL_TASKS_PER_THREAD = 8;
+constexpr size_t PARALLEL_MAX_TASKS = 4096;
+
+bool parallelSolver(Sudoku& sudoku, function<void()> displayFunction);
+
+optional<SolverFunction> findSolver(const string& name) {
+    if (name == "brute") {
+        return SolverFunction(bruteForceSolver);
+    }
+    if (name == "propagate") {
+        return SolverFunction(propagationSolver);
+    }
+    if (name == "logic") {
+        return SolverFunction(logicSolver);
+    }
+    if (name == "fixed") {
+        return SolverFunction(specializedSolver);
+    }
+    if (name == "dlx") {
+        return SolverFunction(dancingLinksSolver);
+    }
+    if (name == "lanes") {
+        return SolverFunction(laneSolver);
+    }
+    if (name == "portfolio") {
+        return SolverFunction(portfolioSolver);
+    }
+    if (name == "parallel") {
+        return SolverFunction(parallelSolver);
+    }
+    return nullopt;
+}
+
+class WorkStealingPool {
+public:
+    using Task = function<void(int worker)>;
+
+private:
+    struct WorkerQueue {
+        mutex lock;
+        deque<Task> tasks;
+    };
+
+    vector<unique_ptr<WorkerQueue>> queues;
+    vector<thread> workers;
+    atomic<size_t> queued;
+    atomic<size_t> pending;
+    atomic<size_t> nextQueue;
+    mutex stateLock;
+    condition_variable workAvailable;
+    condition_variable allDone;
+    bool stopping;
+
+    static thread_local const WorkStealingPool* currentPool;
+    static thread_local int currentWorker;
+
+public:
+    explicit WorkStealingPool(int threadCount = defaultThreadCount())
+        : queued(0), pending(0), nextQueue(0), stopping(false) {
+        threadCount = max(1, threadCount);
+        for (int i = 0; i < threadCount; ++i) {
+            queues.push_back(make_unique<WorkerQueue>());
+        }
+        for (int i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this, i]() { workerLoop(i); });
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            lock_guard<mutex> guard(stateLock);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    static int defaultThreadCount() {
+        return max(1u, thread::hardware_concurrency());
+    }
+
+    int getThreadCount() const { return static_cast<int>(workers.size()); }
+    
+    // wait() from inside a worker would deadlock, so nested parallelism checks this.
+    static bool onWorkerThread() { return currentPool != nullptr; }
+
+    void submit(Task task) {
+        size_t target = currentPool == this
+            ? static_cast<size_t>(currentWorker)
+            : nextQueue.fetch_add(1, memory_order_relaxed) % queues.size();
+        
+        pending.fetch_add(1, memory_order_relaxed);
+        {
+            lock_guard<mutex> guard(queues[target]->lock);
+            queues[target]->tasks.push_back(move(task));
+        }
+        {
+            lock_guard<mutex> guard(stateLock);
+            queued.fetch_add(1, memory_order_release);
+        }
+        workAvailable.notify_one();
+    }
+
+    void wait() {
+        unique_lock<mutex> guard(stateLock);
+        allDone.wait(guard, [this]() { return pending.load(memory_order_acquire) == 0; });
+    }
+
+private:
+    bool tryPop(int worker, Task& task) {
+        WorkerQueue& own = *queues[worker];
+        {
+            lock_guard<mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        
+        for (size_t offset = 1; offset < queues.size(); ++offset) {
+            WorkerQueue& victim = *queues[(worker + offset) % queues.size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(int worker) {
+        currentPool = this;
+        currentWorker = worker;
+        
+        Task task;
+        while (true) {
+            if (tryPop(worker, task)) {
+                queued.fetch_sub(1, memory_order_relaxed);
+                task(worker);
+                task = nullptr;
+                if (pending.fetch_sub(1, memory_order_acq_rel) == 1) {
+                    lock_guard<mutex> guard(stateLock);
+                    allDone.notify_all();
+                }
+                continue;
+            }
+            
+            unique_lock<mutex> guard(stateLock);
+            workAvailable.wait(guard, [this]() {
+                return stopping || queued.load(memory_order_acquire) > 0;
+            });
+            if (stopping && queued.load(memory_order_acquire) == 0) {
+                return;
+            }
+        }
+    }
+};
+
+thread_local const WorkStealingPool* WorkStealingPool::currentPool = nullptr;
+thread_local int WorkStealingPool::currentWorker = 0;
+
+struct LineView {
+    const char* data;
+    size_t length;
+};
+
+class LineReader {
+private:
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 20;
+
+    FILE* input;
+    vector<char> buffer;
+    size_t begin;
+    size_t end;
+    bool eof;
+
+public:
+    explicit LineReader(FILE* inputFile, size_t capacity = DEFAULT_CAPACITY)
+        : input(inputFile), buffer(capacity), begin(0), end(0), eof(false) {}
+
+    // Puts back bytes already read from the stream; only before the first line.
+    void unread(const char* data, size_t length) {
+        memcpy(buffer.data(), data, length);
+        end = length;
+    }
+
+    bool next(const char*& line, size_t& length) {
+        return next(line, length, true);
+    }
+
+    size_t nextBlock(vector<LineView>& lines, size_t maxLines) {
+        lines.clear();
+        const char* line;
+        size_t length;
+        bool allowRefill = true;
+        while (lines.size() < maxLines && next(line, length, allowRefill)) {
+            lines.push_back({line, length});
+            allowRefill = false;
+        }
+        return lines.size();
+    }
+
+private:
+    bool next(const char*& line, size_t& length, bool allowRefill) {
+        while (true) {
+            const char* start = buffer.data() + begin;
+            const char* newline = static_cast<const char*>(memchr(start, '\n', end - begin));
+            
+            if (newline != nullptr) {
+                line = start;
+                length = newline - start;
+                begin += length + 1;
+                trimCarriageReturn(line, length);
+                return true;
+            }
+            
+            if (eof) {
+                if (begin == end) {
+                    return false;
+                }
+                line = start;
+                length = end - begin;
+                begin = end;
+                trimCarriageReturn(line, length);
+                return true;
+            }
+            
+            if (!allowRefill) {
+                return false;
+            }
+            refill();
+        }
+    }
+
+    static void trimCarriageReturn(const char* line, size_t& length) {
+        if (length > 0 && line[length - 1] == '\r') {
+            --length;
+        }
+    }
+
+    void refill() {
+        size_t remaining = end - begin;
+        if (begin > 0) {
+            memmove(buffer.data(), buffer.data() + begin, remaining);
+            begin = 0;
+            end = remaining;
+        }
+        if (end == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        
+        size_t bytesRead = fread(buffer.data() + end, 1, buffer.size() - end, input);
+        end += bytesRead;
+        if (bytesRead == 0) {
+            eof = true;
+        }
+    }
+};
+
+class OutputBuffer {
+private:
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 20;
+
+    FILE* output;
+    vector<char> buffer;
+    size_t used;
+
+public:
+    explicit OutputBuffer(FILE* outputFile, size_t capacity = DEFAULT_CAPACITY)
+        : output(outputFile), buffer(capacity), used(0) {}
+
+    ~OutputBuffer() { flush(); }
+
+    char* reserve(size_t length) {
+        if (used + length > buffer.size()) {
+            flush();
+            if (length > buffer.size()) {
+                buffer.resize(length);
+            }
+        }
+        char* out = buffer.data() + used;
+        used += length;
+        return out;
+    }
+
+    void append(const char* text, size_t length) {
+        memcpy(reserve(length), text, length);
+    }
+
+    void flush() {
+        if (used > 0) {
+            fwrite(buffer.data(), 1, used, output);
+            used = 0;
+        }
+        fflush(output);
+    }
+};
+
+class MappedFile {
+private:
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (data != nullptr) {
+            munmap(const_cast<uint8_t*>(data), length);
+        }
+    }
+
+    // Fails for anything that is not a regular file (pipes, terminals), so
+    // callers can fall back to streaming.
+    bool open(const string& path) {
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(descriptor, &info) != 0 || !S_ISREG(info.st_mode)) {
+            close(descriptor);
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (mapping == MAP_FAILED) {
+                close(descriptor);
+                length = 0;
+                return false;
+            }
+            madvise(mapping, length, MADV_SEQUENTIAL);
+            data = static_cast<const uint8_t*>(mapping);
+        }
+        close(descriptor);
+        return true;
+    }
+
+    const uint8_t* getData() const { return data; }
+    size_t getLength() const { return length; }
+};
+
+constexpr char PACKED_MAGIC[4] = {'S', 'D', 'K', 'P'};
+constexpr uint8_t PACKED_VERSION = 1;
+
+// On disk: magic, version, board size, bits per cell, a reserved byte and the
+// record count as a little-endian uint64, whatever the host byte order.
+struct PackedHeader {
+    static constexpr size_t BYTES = 16;
+
+    uint8_t version = PACKED_VERSION;
+    uint8_t boardSize = 0;
+    uint8_t bitsPerCell = 0;
+    uint64_t count = 0;
+
+    void encode(uint8_t* out) const {
+        memcpy(out, PACKED_MAGIC, sizeof(PACKED_MAGIC));
+        out[4] = version;
+        out[5] = boardSize;
+        out[6] = bitsPerCell;
+        out[7] = 0;
+        for (int i = 0; i < 8; ++i) {
+            out[8 + i] = static_cast<uint8_t>(count >> (8 * i));
+        }
+    }
+
+    static PackedHeader decode(const uint8_t* data) {
+        PackedHeader header;
+        header.version = data[4];
+        header.boardSize = data[5];
+        header.bitsPerCell = data[6];
+        for (int i = 0; i < 8; ++i) {
+            header.count |= static_cast<uint64_t>(data[8 + i]) << (8 * i);
+        }
+        return header;
+    }
+};
+
+// A read-only view of a packed corpus: a header followed by count fixed-size
+// records that are handed to solvers in place.
+class PackedCorpus {
+private:
+    const uint8_t* records;
+    int boardSize;
+    size_t recordBytes;
+    size_t count;
+
+public:
+    PackedCorpus(const uint8_t* data, size_t length) {
+        if (!isPacked(data, length)) {
+            throw invalid_argument("Missing packed corpus header");
+        }
+        PackedHeader header = PackedHeader::decode(data);
+        if (header.version != PACKED_VERSION) {
+            throw invalid_argument("Unsupported packed corpus version " + to_string(header.version));
+        }
+        if (header.boardSize < 1 || header.boardSize > Sudoku::MAX_SIZE ||
+            header.bitsPerCell != packedBitsPerCell(header.boardSize)) {
+            throw invalid_argument("Corrupt packed corpus header");
+        }
+        boardSize = header.boardSize;
+        recordBytes = packedRecordBytes(boardSize);
+        count = header.count;
+        if (count > (length - PackedHeader::BYTES) / recordBytes) {
+            throw invalid_argument("Packed corpus is truncated");
+        }
+        records = data + PackedHeader::BYTES;
+    }
+
+    static bool isPacked(const uint8_t* data, size_t length) {
+        return data != nullptr && length >= PackedHeader::BYTES && memcmp(data, PACKED_MAGIC, 4) == 0;
+    }
+
+    int getBoardSize() const { return boardSize; }
+    size_t getRecordBytes() const { return recordBytes; }
+    size_t size() const { return count; }
+    const uint8_t* record(size_t index) const { return records + index * recordBytes; }
+};
+
+void writePackedHeader(OutputBuffer& writer, int boardSize, uint64_t count) {
+    PackedHeader header;
+    header.boardSize = static_cast<uint8_t>(boardSize);
+    header.bitsPerCell = static_cast<uint8_t>(packedBitsPerCell(boardSize));
+    header.count = count;
+    uint8_t bytes[PackedHeader::BYTES];
+    header.encode(bytes);
+    writer.append(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+}
+
+struct BatchSummary {
+    long long solved = 0;
+    long long unsolvable = 0;
+    long long invalid = 0;
+    long long timedOut = 0;
+    long long cacheHits = 0;
+};
+
+optional<int> detectBoardSize(size_t length) {
+    int boardSize = static_cast<int>(lround(sqrt(static_cast<double>(length))));
+    if (boardSize < 1 || static_cast<size_t>(boardSize) * boardSize != length) {
+        return nullopt;
+    }
+    return boardSize;
+}
+
+// Maps a board to a representative of its symmetry class: transposition,
+// band/stack order, row/column order within them, then digits relabelled by
+// first appearance. Orders come from clue-position invariants, so equivalent
+// puzzles usually (not always, when invariants tie) share a form; either way
+// the form is an equivalent puzzle, and its solution maps back exactly.
+class Canonicalizer {
+private:
+    int size = 0;
+    int boxSize = 0;
+    vector<uint64_t> rowKeys;
+    vector<uint64_t> colKeys;
+    vector<uint64_t> refined;
+    vector<int> rowPerm;
+    vector<int> colPerm;
+    vector<int> bandOrder;
+    vector<int> candidateSource;
+    vector<uint8_t> candidateMap;
+    vector<uint8_t> candidate;
+    vector<int> sourceCell;
+    vector<uint8_t> digitMap;
+    vector<uint8_t> inverseMap;
+    vector<uint8_t> canonical;
+
+public:
+    Canonicalizer() {
+        size_t cells = static_cast<size_t>(Sudoku::MAX_SIZE) * Sudoku::MAX_SIZE;
+        rowKeys.resize(Sudoku::MAX_SIZE);
+        colKeys.resize(Sudoku::MAX_SIZE);
+        refined.resize(Sudoku::MAX_SIZE);
+        rowPerm.resize(Sudoku::MAX_SIZE);
+        colPerm.resize(Sudoku::MAX_SIZE);
+        bandOrder.resize(Sudoku::MAX_SIZE);
+        candidateSource.resize(cells);
+        sourceCell.resize(cells);
+        candidateMap.resize(Sudoku::MAX_SIZE + 1);
+        digitMap.resize(Sudoku::MAX_SIZE + 1);
+        inverseMap.resize(Sudoku::MAX_SIZE + 1);
+        candidate.resize(cells);
+        canonical.resize(cells);
+    }
+
+    const uint8_t* canonicalize(const Sudoku& sudoku) {
+        size = sudoku.getSize();
+        boxSize = sudoku.getBoxSize();
+        int cellCount = sudoku.getCellCount();
+        for (int transpose = 0; transpose < 2; ++transpose) {
+            orient(sudoku.getCells(), transpose == 1);
+            if (transpose == 0 || memcmp(candidate.data(), canonical.data(), cellCount) < 0) {
+                candidate.swap(canonical);
+                candidateSource.swap(sourceCell);
+                candidateMap.swap(digitMap);
+            }
+        }
+        for (int digit = 0; digit <= size; ++digit) {
+            inverseMap[digitMap[digit]] = static_cast<uint8_t>(digit);
+        }
+        return canonical.data();
+    }
+
+    void toCanonical(const uint8_t* cells, uint8_t* out) const {
+        for (int cell = 0; cell < size * size; ++cell) {
+            out[cell] = digitMap[cells[sourceCell[cell]]];
+        }
+    }
+
+    void fromCanonical(const uint8_t* cells, uint8_t* out) const {
+        for (int cell = 0; cell < size * size; ++cell) {
+            out[sourceCell[cell]] = inverseMap[cells[cell]];
+        }
+    }
+
+private:
+    int sourceIndex(int row, int col, bool transpose) const {
+        return transpose ? col * size + row : row * size + col;
+    }
+
+    // Two refinement rounds: a line's key mixes its clue count with the keys
+    // of the crossing lines that hold its clues, all invariant under the group.
+    void computeKeys(const uint8_t* cells, bool transpose) {
+        for (int i = 0; i < size; ++i) {
+            rowKeys[i] = 0;
+            colKeys[i] = 0;
+        }
+        for (int row = 0; row < size; ++row) {
+            for (int col = 0; col < size; ++col) {
+                if (cells[sourceIndex(row, col, transpose)] != 0) {
+                    ++rowKeys[row];
+                    ++colKeys[col];
+                }
+            }
+        }
+        for (int round = 0; round < 2; ++round) {
+            for (int row = 0; row < size; ++row) {
+                uint64_t key = rowKeys[row] * 0x9E3779B97F4A7C15ULL;
+                for (int col = 0; col < size; ++col) {
+                    if (cells[sourceIndex(row, col, transpose)] != 0) {
+                        key += mixSeed(colKeys[col], 0);
+                    }
+                }
+                refined[row] = key;
+            }
+            for (int col = 0; col < size; ++col) {
+                uint64_t key = colKeys[col] * 0x9E3779B97F4A7C15ULL;
+                for (int row = 0; row < size; ++row) {
+                    if (cells[sourceIndex(row, col, transpose)] != 0) {
+                        key += mixSeed(rowKeys[row], 0);
+                    }
+                }
+                colKeys[col] = key;
+            }
+            copy(refined.begin(), refined.begin() + size, rowKeys.begin());
+        }
+    }
+
+    // Orders lines inside each group by descending key, then the groups by
+    // their key sequences. Insertion sorts keep this stable and allocation-free.
+    void orderLines(const vector<uint64_t>& keys, vector<int>& perm) {
+        for (int i = 0; i < size; ++i) {
+            perm[i] = i;
+        }
+        for (int group = 0; group < size; group += boxSize) {
+            for (int i = group + 1; i < group + boxSize; ++i) {
+                for (int j = i; j > group && keys[perm[j]] > keys[perm[j - 1]]; --j) {
+                    swap(perm[j], perm[j - 1]);
+                }
+            }
+        }
+        auto groupBefore = [&](int a, int b) {
+            for (int i = 0; i < boxSize; ++i) {
+                uint64_t left = keys[perm[a * boxSize + i]];
+                uint64_t right = keys[perm[b * boxSize + i]];
+                if (left != right) {
+                    return left > right;
+                }
+            }
+            return false;
+        };
+        for (int i = 0; i < boxSize; ++i) {
+            bandOrder[i] = i;
+        }
+        for (int i = 1; i < boxSize; ++i) {
+            for (int j = i; j > 0 && groupBefore(bandOrder[j], bandOrder[j - 1]); --j) {
+                swap(bandOrder[j], bandOrder[j - 1]);
+            }
+        }
+        for (int i = 0; i < size; ++i) {
+            refined[i] = static_cast<uint64_t>(perm[bandOrder[i / boxSize] * boxSize + i % boxSize]);
+        }
+        for (int i = 0; i < size; ++i) {
+            perm[i] = static_cast<int>(refined[i]);
+        }
+    }
+
+    void orient(const uint8_t* cells, bool transpose) {
+        computeKeys(cells, transpose);
+        orderLines(rowKeys, rowPerm);
+        orderLines(colKeys, colPerm);
+        
+        fill(candidateMap.begin(), candidateMap.end(), 0);
+        int nextDigit = 0;
+        for (int row = 0; row < size; ++row) {
+            for (int col = 0; col < size; ++col) {
+                int source = sourceIndex(rowPerm[row], colPerm[col], transpose);
+                int value = cells[source];
+                if (value != 0 && candidateMap[value] == 0) {
+                    candidateMap[value] = static_cast<uint8_t>(++nextDigit);
+                }
+                candidateSource[row * size + col] = source;
+                candidate[row * size + col] = candidateMap[value];
+            }
+        }
+        for (int digit = 1; digit <= size; ++digit) {
+            if (candidateMap[digit] == 0) {
+                candidateMap[digit] = static_cast<uint8_t>(++nextDigit);
+            }
+        }
+    }
+};
+
+inline uint64_t hashCells(const uint8_t* cells, size_t length) {
+    uint64_t hash = length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, cells + i, sizeof(word));
+        hash = mixSeed(hash, word);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, cells + i, length - i);
+    return mixSeed(hash, tail);
+}
+
+// Bounded LRU from canonical puzzle to canonical solution, split into shards
+// that each have their own lock and an even share of the capacity. Small
+// caches use fewer shards, so LRU order holds over at least
+// MIN_SHARD_CAPACITY entries at a time. Entries are found by hash and
+// confirmed by comparing the stored key, so lookups never allocate.
+class SolutionCache {
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+    static constexpr size_t MIN_SHARD_CAPACITY = 1024;
+
+    struct Entry {
+        uint64_t hash;
+        string key;
+        string solution;
+    };
+
+    struct Shard {
+        mutex lock;
+        size_t capacity = 0;
+        list<Entry> entries;
+        unordered_map<uint64_t, list<Entry>::iterator> index;
+    };
+
+    size_t shardCount;
+    unique_ptr<Shard[]> shards;
+    atomic<long long> hits{0};
+
+public:
+    explicit SolutionCache(size_t capacity)
+        : shardCount(clamp<size_t>(capacity / MIN_SHARD_CAPACITY, 1, SHARD_COUNT)), shards(new Shard[shardCount]) {
+        for (size_t i = 0; i < shardCount; ++i) {
+            shards[i].capacity = max<size_t>(1, capacity / shardCount + (i < capacity % shardCount ? 1 : 0));
+        }
+    }
+
+    bool lookup(const uint8_t* key, size_t length, uint64_t hash, uint8_t* solutionOut) {
+        Shard& shard = shards[hash % shardCount];
+        lock_guard<mutex> guard(shard.lock);
+        auto found = shard.index.find(hash);
+        if (found == shard.index.end()) {
+            return false;
+        }
+        const Entry& entry = *found->second;
+        if (entry.key.size() != length || memcmp(entry.key.data(), key, length) != 0) {
+            return false;
+        }
+        shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+        memcpy(solutionOut, entry.solution.data(), length);
+        hits.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+
+    void insert(const uint8_t* key, size_t length, uint64_t hash, const uint8_t* solution) {
+        Shard& shard = shards[hash % shardCount];
+        lock_guard<mutex> guard(shard.lock);
+        auto found = shard.index.find(hash);
+        if (found != shard.index.end()) {
+            shard.entries.erase(found->second);
+            shard.index.erase(found);
+        }
+        shard.entries.push_front({hash, string(reinterpret_cast<const char*>(key), length),
+                                  string(reinterpret_cast<const char*>(solution), length)});
+        shard.index[hash] = shard.entries.begin();
+        if (shard.entries.size() > shard.capacity) {
+            shard.index.erase(shard.entries.back().hash);
+            shard.entries.pop_back();
+        }
+    }
+
+    long long getHits() const { return hits.load(); }
+};
+
+// Reusable per-thread solving state: the board lives in an arena sized for the
+// largest supported board, so a stream of puzzles is loaded without allocating.
+class SolveContext {
+private:
+    Arena arena;
+    SolverFunction solver;
+    optional<Sudoku> sudoku;
+    Canonicalizer canonicalizer;
+    vector<uint8_t> canonicalSolution;
+    vector<uint8_t> solution;
+    SolveLimits limits;
+
+public:
+    explicit SolveContext(SolverFunction solverFunc = nullptr)
+        : arena(Sudoku::storageBytesFor(Sudoku::MAX_SIZE)), solver(move(solverFunc)),
+          canonicalSolution(Sudoku::MAX_SIZE * Sudoku::MAX_SIZE),
+          solution(Sudoku::MAX_SIZE * Sudoku::MAX_SIZE) {}
+
+    // With a cache, an equivalent puzzle seen before is answered by mapping its
+    // stored canonical solution back instead of searching.
+    SolveResult solve(Sudoku& board, SolutionCache* cache) {
+        if (cache == nullptr) {
+            return board.solveHeadless();
+        }
+        
+        size_t length = board.getCellCount();
+        const uint8_t* key = canonicalizer.canonicalize(board);
+        uint64_t hash = hashCells(key, length);
+        if (cache->lookup(key, length, hash, canonicalSolution.data())) {
+            canonicalizer.fromCanonical(canonicalSolution.data(), solution.data());
+            board.fillFrom(solution.data());
+            return {true, 0};
+        }
+        
+        SolveResult result = board.solveHeadless();
+        if (result.solved) {
+            canonicalizer.toCanonical(board.getCells(), canonicalSolution.data());
+            cache->insert(key, length, hash, canonicalSolution.data());
+        }
+        return result;
+    }
+
+    void setLimits(const SolveLimits& solveLimits) {
+        limits = solveLimits;
+        if (sudoku.has_value()) {
+            sudoku->setLimits(limits);
+        }
+    }
+
+    Sudoku* load(const char* text, size_t length) {
+        auto boardSize = detectBoardSize(length);
+        if (!boardSize.has_value() || !reshape(boardSize.value())) {
+            return nullptr;
+        }
+        return sudoku->loadPuzzle(text, length) ? &sudoku.value() : nullptr;
+    }
+
+    Sudoku* loadPacked(const uint8_t* record, int boardSize) {
+        if (!reshape(boardSize)) {
+            return nullptr;
+        }
+        return sudoku->loadPacked(record) ? &sudoku.value() : nullptr;
+    }
+
+private:
+    bool reshape(int boardSize) {
+        if (sudoku.has_value() && sudoku->getSize() == boardSize) {
+            return true;
+        }
+        sudoku.reset();
+        arena.reset();
+        try {
+            sudoku.emplace(Sudoku::createEmpty(boardSize, solver, &arena));
+        } catch (const invalid_argument&) {
+            return false;
+        }
+        sudoku->setLimits(limits);
+        return true;
+    }
+};
+
+struct BatchOptions {
+    int threadCount = 1;
+    bool grade = false;
+    bool binaryOutput = false;
+    int packedBoardSize = 0;
+    size_t cacheCapacity = 0;
+    SolveLimits limits;
+    optional<BatchBackend> backend;
+};
+
+void appendGrade(vector<char>& output, const SolveStats& stats) {
+    char line[256];
+    int length = snprintf(line, sizeof(line),
+                          "%s guesses=%lld backtracks=%lld rounds=%lld depth=%d naked=%lld hidden=%lld"
+                          " locked=%lld nakedSubsets=%lld hiddenSubsets=%lld xwings=%lld\n",
+                          gradeDifficulty(stats), stats.guesses, stats.backtracks, stats.propagationRounds,
+                          stats.maxDepth, stats.nakedSingles, stats.hiddenSingles, stats.lockedCandidates,
+                          stats.nakedSubsets, stats.hiddenSubsets, stats.xWings);
+    output.insert(output.end(), line, line + length);
+}
+
+void solveBatchLine(SolveContext& context, SolutionCache* cache, LineView line, const BatchOptions& options,
+                    vector<char>& output, BatchSummary& summary) {
+    static constexpr char UNSOLVABLE[] = "unsolvable\n";
+    static constexpr char INVALID[] = "invalid\n";
+    static constexpr char TIMEOUT[] = "timeout\n";
+    static constexpr char ABORTED[] = "aborted\n";
+    
+    Sudoku* sudoku = options.packedBoardSize > 0
+        ? context.loadPacked(reinterpret_cast<const uint8_t*>(line.data), options.packedBoardSize)
+        : context.load(line.data, line.length);
+    
+    // Packed output keeps one record per input record; an all-empty board
+    // stands for an invalid or unsolvable puzzle.
+    if (options.binaryOutput) {
+        size_t offset = output.size();
+        output.resize(offset + packedRecordBytes(options.packedBoardSize), 0);
+        if (sudoku == nullptr) {
+            ++summary.invalid;
+            return;
+        }
+        SolveResult result = context.solve(*sudoku, cache);
+        if (result.solved) {
+            sudoku->writePacked(reinterpret_cast<uint8_t*>(output.data() + offset));
+            ++summary.solved;
+        } else if (result.abortReason != AbortReason::None) {
+            ++summary.timedOut;
+        } else {
+            ++summary.unsolvable;
+        }
+        return;
+    }
+    
+    if (sudoku == nullptr) {
+        output.insert(output.end(), INVALID, INVALID + sizeof(INVALID) - 1);
+        ++summary.invalid;
+        return;
+    }
+    
+    SolveResult result = context.solve(*sudoku, options.grade ? nullptr : cache);
+    if (result.solved) {
+        ++summary.solved;
+        if (options.grade) {
+            appendGrade(output, sudoku->getStats());
+            return;
+        }
+        size_t length = sudoku->getCellCount();
+        size_t offset = output.size();
+        output.resize(offset + length + 1);
+        sudoku->writeBoard(output.data() + offset);
+        output[offset + length] = '\n';
+    } else if (result.abortReason == AbortReason::Cancelled) {
+        output.insert(output.end(), ABORTED, ABORTED + sizeof(ABORTED) - 1);
+        ++summary.timedOut;
+    } else if (result.abortReason != AbortReason::None) {
+        output.insert(output.end(), TIMEOUT, TIMEOUT + sizeof(TIMEOUT) - 1);
+        ++summary.timedOut;
+    } else {
+        output.insert(output.end(), UNSOLVABLE, UNSOLVABLE + sizeof(UNSOLVABLE) - 1);
+        ++summary.unsolvable;
+    }
+}
+
+// Hands the chunk's boards of the backend's size to one kernel call and
+// writes every line's answer in input order; boards of other sizes, and
+// invalid lines, take the per-puzzle path. Boards the kernel hands back as
+// stalled are finished by the fixed engine.
+void solveChunkOnBackend(SolveContext& context, SolutionCache* cache, const LineView* lines, size_t count,
+                         const BatchOptions& options, vector<char>& output, BatchSummary& summary) {
+    static constexpr char UNSOLVABLE[] = "unsolvable\n";
+    static constexpr int SKIPPED = -2;
+    static constexpr int PER_PUZZLE = -1;
+    
+    thread_local vector<uint8_t> boards;
+    thread_local vector<KernelResult> results;
+    thread_local vector<int> slots;
+    const BatchBackend& backend = options.backend.value();
+    size_t cellCount = static_cast<size_t>(backend.boardSize) * backend.boardSize;
+    
+    auto load = [&context, &options](LineView line) {
+        return options.packedBoardSize > 0
+            ? context.loadPacked(reinterpret_cast<const uint8_t*>(line.data), options.packedBoardSize)
+            : context.load(line.data, line.length);
+    };
+    
+    boards.clear();
+    slots.assign(count, PER_PUZZLE);
+    for (size_t i = 0; i < count; ++i) {
+        if (options.packedBoardSize == 0 && (lines[i].length == 0 || lines[i].data[0] == '#')) {
+            slots[i] = SKIPPED;
+            continue;
+        }
+        Sudoku* sudoku = load(lines[i]);
+        if (sudoku != nullptr && sudoku->getSize() == backend.boardSize) {
+            slots[i] = static_cast<int>(boards.size() / cellCount);
+            boards.insert(boards.end(), sudoku->getCells(), sudoku->getCells() + cellCount);
+        }
+    }
+    
+    results.assign(boards.size() / cellCount, KernelResult::Unsolvable);
+    if (!results.empty()) {
+        backend.kernel(boards.data(), results.size(), results.data());
+    }
+    
+    for (size_t i = 0; i < count; ++i) {
+        if (slots[i] == SKIPPED) {
+            continue;
+        }
+        if (slots[i] == PER_PUZZLE) {
+            solveBatchLine(context, cache, lines[i], options, output, summary);
+            continue;
+        }
+        uint8_t* board = boards.data() + slots[i] * cellCount;
+        if (results[slots[i]] == KernelResult::Stalled) {
+            Sudoku* sudoku = load(lines[i]);
+            sudoku->getGuard().start();
+            if (specializedSolver(*sudoku, nullptr)) {
+                memcpy(board, sudoku->getCells(), cellCount);
+                results[slots[i]] = KernelResult::Solved;
+            }
+        }
+        bool solved = results[slots[i]] == KernelResult::Solved;
+        if (solved) {
+            ++summary.solved;
+        } else {
+            ++summary.unsolvable;
+        }
+        size_t offset = output.size();
+        if (options.binaryOutput) {
+            output.resize(offset + packedRecordBytes(backend.boardSize), 0);
+            if (solved) {
+                packCells(board, static_cast<int>(cellCount), packedBitsPerCell(backend.boardSize),
+                          reinterpret_cast<uint8_t*>(output.data() + offset));
+            }
+        } else if (solved) {
+            output.resize(offset + cellCount + 1);
+            for (size_t cell = 0; cell < cellCount; ++cell) {
+                output[offset + cell] = symbolForValue(board[cell]);
+            }
+            output[offset + cellCount] = '\n';
+        } else {
+            output.insert(output.end(), UNSOLVABLE, UNSOLVABLE + sizeof(UNSOLVABLE) - 1);
+        }
+    }
+}
+
+using BlockSource = function<size_t(vector<LineView>&, size_t)>;
+
+BatchSummary runBatchBlocks(const BlockSource& nextBlock, OutputBuffer& writer, const SolverFunction& solver,
+                            const BatchOptions& options) {
+    static constexpr size_t BLOCK_LINES = 1 << 14;
+    static constexpr size_t CHUNK_LINES = 64;
+    
+    struct Chunk {
+        size_t first = 0;
+        size_t count = 0;
+        vector<char> output;
+        BatchSummary summary;
+    };
+    
+    BatchSummary summary;
+    vector<LineView> lines;
+    lines.reserve(BLOCK_LINES);
+    vector<Chunk> chunks((BLOCK_LINES + CHUNK_LINES - 1) / CHUNK_LINES);
+    
+    unique_ptr<WorkStealingPool> pool;
+    if (options.threadCount > 1) {
+        pool = make_unique<WorkStealingPool>(options.threadCount);
+    }
+    unique_ptr<SolutionCache> cache;
+    if (options.cacheCapacity > 0 && !options.grade) {
+        cache = make_unique<SolutionCache>(options.cacheCapacity);
+    }
+    vector<SolveContext> workerContexts;
+    workerContexts.reserve(max(1, options.threadCount));
+    for (int worker = 0; worker < max(1, options.threadCount); ++worker) {
+        workerContexts.emplace_back(solver);
+        workerContexts.back().setLimits(options.limits);
+    }
+    
+    while (nextBlock(lines, BLOCK_LINES) > 0) {
+        size_t chunkCount = (lines.size() + CHUNK_LINES - 1) / CHUNK_LINES;
+        
+        auto runChunk = [&](size_t index, int worker) {
+            SUDOKU_TRACE_SPAN("batchChunk");
+            Chunk& chunk = chunks[index];
+            chunk.output.clear();
+            chunk.summary = BatchSummary();
+            if (options.backend.has_value()) {
+                solveChunkOnBackend(workerContexts[worker], cache.get(), &lines[chunk.first], chunk.count, options,
+                                    chunk.output, chunk.summary);
+                return;
+            }
+            for (size_t i = chunk.first; i < chunk.first + chunk.count; ++i) {
+                if (options.packedBoardSize == 0 && (lines[i].length == 0 || lines[i].data[0] == '#')) {
+                    continue;
+                }
+                solveBatchLine(workerContexts[worker], cache.get(), lines[i], options, chunk.output, chunk.summary);
+            }
+        };
+        
+        for (size_t index = 0; index < chunkCount; ++index) {
+            chunks[index].first = index * CHUNK_LINES;
+            chunks[index].count = min(CHUNK_LINES, lines.size() - chunks[index].first);
+            if (pool) {
+                pool->submit([&runChunk, index](int worker) { runChunk(index, worker); });
+            } else {
+                runChunk(index, 0);
+            }
+        }
+        if (pool) {
+            pool->wait();
+        }
+        
+        for (size_t index = 0; index < chunkCount; ++index) {
+            const Chunk& chunk = chunks[index];
+            writer.append(chunk.output.data(), chunk.output.size());
+            summary.solved += chunk.summary.solved;
+            summary.unsolvable += chunk.summary.unsolvable;
+            summary.invalid += chunk.summary.invalid;
+            summary.timedOut += chunk.summary.timedOut;
+        }
+    }
+    
+    if (cache) {
+        summary.cacheHits = cache->getHits();
+    }
+    return summary;
+}
+
+BatchSummary runBatch(FILE* input, FILE* output, const SolverFunction& solver, const BatchOptions& options,
+                      const string& alreadyRead = string()) {
+    LineReader reader(input);
+    reader.unread(alreadyRead.data(), alreadyRead.size());
+    OutputBuffer writer(output);
+    return runBatchBlocks([&reader](vector<LineView>& lines, size_t maxLines) {
+        return reader.nextBlock(lines, maxLines);
+    }, writer, solver, options);
+}
+
+BatchSummary runPackedBatch(const PackedCorpus& corpus, FILE* output, const SolverFunction& solver,
+                            BatchOptions options) {
+    options.packedBoardSize = corpus.getBoardSize();
+    OutputBuffer writer(output);
+    if (options.binaryOutput) {
+        writePackedHeader(writer, corpus.getBoardSize(), corpus.size());
+    }
+    
+    size_t next = 0;
+    return runBatchBlocks([&corpus, &next](vector<LineView>& lines, size_t maxLines) {
+        lines.clear();
+        for (; next < corpus.size() && lines.size() < maxLines; ++next) {
+            lines.push_back({reinterpret_cast<const char*>(corpus.record(next)), corpus.getRecordBytes()});
+        }
+        return lines.size();
+    }, writer, solver, options);
+}
+
+// Expands the shallowest open node one at a time until there are about
+// taskCount subtrees, so a wide board stops after a few levels instead of
+// copying the whole product of its first branchings. Forced cells are followed
+// without adding tasks, and dead ends are dropped.
+vector<Sudoku> collectSearchFrontier(const Sudoku& puzzle, size_t taskCount, long long& solvedLeaves,
+                                     optional<Sudoku>* firstSolved = nullptr) {
+    deque<Sudoku> open;
+    open.push_back(puzzle);
+    while (!open.empty() && open.size() < taskCount) {
+        Sudoku work = move(open.front());
+        open.pop_front();
+        
+        auto branch = work.findMostConstrainedCell();
+        if (!branch.has_value()) {
+            if (firstSolved != nullptr && !firstSolved->has_value()) {
+                *firstSolved = work;
+            }
+            ++solvedLeaves;
+            continue;
+        }
+        
+        auto [cell, candidates] = branch.value();
+        for (; candidates != 0; candidates &= candidates - 1) {
+            work.place(cell, lowestCandidate(candidates));
+            open.push_back(work);
+            work.unplace(cell);
+        }
+    }
+    return vector<Sudoku>(make_move_iterator(open.begin()), make_move_iterator(open.end()));
+}
+
+size_t parallelTaskCount(const WorkStealingPool& pool) {
+    return min(PARALLEL_MAX_TASKS, PARALLEL_TASKS_PER_THREAD * static_cast<size_t>(pool.getThreadCount()));
+}
+
+long long countSolutionsParallel(const Sudoku& puzzle, long long limit, WorkStealingPool* pool) {
+    if (pool == nullptr || pool->getThreadCount() < 2) {
+        Sudoku work = puzzle;
+        return work.countSolutions(limit);
+    }
+    
+    long long solvedLeaves = 0;
+    vector<Sudoku> frontier = collectSearchFrontier(puzzle, parallelTaskCount(*pool), solvedLeaves);
+    
+    atomic<long long> total(solvedLeaves);
+    for (Sudoku& subtree : frontier) {
+        pool->submit([&total, &subtree, limit](int) {
+            long long remaining = limit - total.load(memory_order_relaxed);
+            if (remaining > 0) {
+                total.fetch_add(subtree.countSolutions(remaining), memory_order_relaxed);
+            }
+        });
+    }
+    pool->wait();
+    
+    return min(total.load(), limit);
+}
+
+// An MRV solution count whose whole state is an explicit stack of frames: a
+// cell, the value placed there (0 while the next one is being chosen) and the
+// candidates not tried yet. The board and its masks follow from the puzzle and
+// the placed values, so a checkpoint costs a line per level and resumes on
+// any machine. The top frame's placed value has always been fully explored.
+// split() gives the untried candidates of the shallowest open frame to a new
+// cursor, which then owns those subtrees outright.
+class SearchCursor {
+public:
+    struct Frame {
+        int cell;
+        int value;
+        Sudoku::CandidateMask untried;
+    };
+
+private:
+    static constexpr char MAGIC[] = "sudoku-search 1";
+
+    Sudoku board;
+    vector<uint8_t> puzzle;
+    vector<Frame> frames;
+    long long found = 0;
+    long long nodes = 0;
+
+public:
+    explicit SearchCursor(const Sudoku& root)
+        : board(root), puzzle(root.getCells(), root.getCells() + root.getCellCount()) {
+        descend();
+    }
+
+    long long getFound() const { return found; }
+    long long getNodes() const { return nodes; }
+    bool isFinished() const { return frames.empty(); }
+
+    // Runs at most nodeBudget placements; true once the tree is exhausted or
+    // limit solutions have been counted.
+    bool run(long long limit, long long nodeBudget) {
+        while (!frames.empty() && found < limit && nodeBudget-- > 0) {
+            Frame& frame = frames.back();
+            if (frame.value != 0) {
+                board.unplace(frame.cell);
+                frame.value = 0;
+            }
+            if (frame.untried == 0) {
+                frames.pop_back();
+                continue;
+            }
+            frame.value = lowestCandidate(frame.untried);
+            frame.untried &= frame.untried - 1;
+            board.place(frame.cell, frame.value);
+            ++nodes;
+            descend();
+        }
+        return frames.empty() || found >= limit;
+    }
+
+    // Depth of the shallowest frame with untried candidates, or SIZE_MAX.
+    size_t openDepth() const {
+        for (size_t depth = 0; depth < frames.size(); ++depth) {
+            if (frames[depth].untried != 0) {
+                return depth;
+            }
+        }
+        return SIZE_MAX;
+    }
+
+    optional<SearchCursor> split() {
+        size_t depth = openDepth();
+        if (depth == SIZE_MAX) {
+            return nullopt;
+        }
+        
+        Sudoku::CandidateMask stolen = frames[depth].untried;
+        for (int kept = countCandidates(stolen) / 2; kept > 0; --kept) {
+            stolen &= stolen - 1;
+        }
+        frames[depth].untried &= ~stolen;
+        
+        vector<Frame> path(frames.begin(), frames.begin() + depth + 1);
+        for (Frame& frame : path) {
+            frame.untried = 0;
+        }
+        path.back() = {path.back().cell, 0, stolen};
+        return SearchCursor(rootBoard(), move(path), 0, 0);
+    }
+
+    string serialize() const {
+        string text = string(MAGIC) + "\npuzzle ";
+        for (uint8_t value : puzzle) {
+            text += symbolForValue(value);
+        }
+        text += "\nfound " + to_string(found) + "\nnodes " + to_string(nodes) + "\n";
+        for (const Frame& frame : frames) {
+            char line[64];
+            int length = snprintf(line, sizeof(line), "frame %d %d %llx\n", frame.cell, frame.value,
+                                  static_cast<unsigned long long>(frame.untried));
+            text.append(line, length);
+        }
+        return text;
+    }
+
+    static SearchCursor parse(const string& text) {
+        size_t position = 0;
+        auto nextLine = [&]() {
+            size_t end = text.find('\n', position);
+            if (end == string::npos) {
+                end = text.size();
+            }
+            string line = text.substr(position, end - position);
+            position = min(text.size(), end + 1);
+            return line;
+        };
+        auto field = [&](const char* name) {
+            string line = nextLine();
+            size_t nameLength = strlen(name);
+            if (line.compare(0, nameLength, name) != 0 || line.size() <= nameLength || line[nameLength] != ' ') {
+                throw invalid_argument(string("expected '") + name + "' line");
+            }
+            return line.substr(nameLength + 1);
+        };
+        
+        if (nextLine() != MAGIC) {
+            throw invalid_argument("not a search checkpoint");
+        }
+        string cells = field("puzzle");
+        optional<int> boardSize = detectBoardSize(cells.size());
+        if (!boardSize.has_value()) {
+            throw invalid_argument("puzzle is not a square board");
+        }
+        Sudoku root = Sudoku::createEmpty(boardSize.value());
+        if (!root.loadPuzzle(cells.data(), cells.size())) {
+            throw invalid_argument("invalid puzzle");
+        }
+        long long found = atoll(field("found").c_str());
+        long long nodes = atoll(field("nodes").c_str());
+        
+        vector<Frame> frames;
+        while (position < text.size()) {
+            string line = nextLine();
+            if (line.empty()) {
+                continue;
+            }
+            Frame frame;
+            unsigned long long untried;
+            if (sscanf(line.c_str(), "frame %d %d %llx", &frame.cell, &frame.value, &untried) != 3) {
+                throw invalid_argument("bad frame: " + line);
+            }
+            frame.untried = static_cast<Sudoku::CandidateMask>(untried);
+            frames.push_back(frame);
+        }
+        return SearchCursor(move(root), move(frames), found, nodes);
+    }
+
+private:
+    SearchCursor(Sudoku root, vector<Frame> path, long long foundSoFar, long long nodesSoFar)
+        : board(move(root)), puzzle(board.getCells(), board.getCells() + board.getCellCount()),
+          frames(move(path)), found(foundSoFar), nodes(nodesSoFar) {
+        for (size_t depth = 0; depth < frames.size(); ++depth) {
+            const Frame& frame = frames[depth];
+            if (frame.cell < 0 || frame.cell >= board.getCellCount() || board.getCells()[frame.cell] != 0 ||
+                (frame.untried & ~board.getFullMask()) != 0) {
+                throw invalid_argument("frame " + to_string(depth) + " does not fit the board");
+            }
+            if (frame.value == 0) {
+                if (depth + 1 != frames.size()) {
+                    throw invalid_argument("only the deepest frame may be unplaced");
+                }
+                continue;
+            }
+            if (frame.value > board.getSize() || !board.isValidPlacement(frame.cell, frame.value)) {
+                throw invalid_argument("frame " + to_string(depth) + " places a conflicting value");
+            }
+            board.place(frame.cell, frame.value);
+        }
+    }
+
+    Sudoku rootBoard() const {
+        Sudoku root = Sudoku::createEmpty(board.getSize());
+        for (int cell = 0; cell < root.getCellCount(); ++cell) {
+            if (puzzle[cell] != 0) {
+                root.place(cell, puzzle[cell]);
+            }
+        }
+        return root;
+    }
+
+    // Pushes the next branching cell, or counts the board when it is full.
+    void descend() {
+        auto branch = board.findMostConstrainedCell();
+        if (!branch.has_value()) {
+            ++found;
+        } else if (branch->second != 0) {
+            frames.push_back({branch->first, 0, branch->second});
+        }
+    }
+};
+
+// Splits the top of an MRV search into independent subtrees, each a flat copy
+// of the board, and solves them on the pool. The tasks share the parent's
+// deadline and remaining steps. The first subtree to solve, or to run out of
+// budget, cancels the shared token and the rest stop at their next poll.
+bool solveParallel(Sudoku& puzzle, WorkStealingPool& pool, const SolverFunction& engine) {
+    long long solvedLeaves = 0;
+    optional<Sudoku> solvedLeaf;
+    vector<Sudoku> frontier = collectSearchFrontier(puzzle, parallelTaskCount(pool), solvedLeaves, &solvedLeaf);
+    
+    const SolveLimits& parentLimits = puzzle.getGuard().getLimits();
+    CancellationToken found(parentLimits.cancellation);
+    atomic<long long> sharedSteps(0);
+    SolveLimits taskLimits = parentLimits;
+    taskLimits.cancellation = &found;
+    taskLimits.deadline = puzzle.getGuard().getDeadline();
+    if (parentLimits.stepLimit > 0 && parentLimits.sharedSteps == nullptr) {
+        taskLimits.stepLimit = max(1LL, parentLimits.stepLimit - puzzle.getSteps());
+        taskLimits.sharedSteps = &sharedSteps;
+    }
+    
+    atomic<int> winner(-1);
+    vector<SolveResult> results(frontier.size(), SolveResult{false, 0});
+    if (!solvedLeaf.has_value()) {
+        for (size_t i = 0; i < frontier.size(); ++i) {
+            frontier[i].setSolver(engine);
+            frontier[i].setLimits(taskLimits);
+            pool.submit([&frontier, &results, &winner, &found, i](int) {
+                if (found.isCancelled()) {
+                    return;
+                }
+                results[i] = frontier[i].solveHeadless();
+                int none = -1;
+                if (results[i].solved && winner.compare_exchange_strong(none, static_cast<int>(i))) {
+                    found.cancel();
+                } else if (results[i].abortReason != AbortReason::None) {
+                    found.cancel();
+                }
+            });
+        }
+        pool.wait();
+    }
+    
+    const Sudoku* solved = solvedLeaf.has_value() ? &solvedLeaf.value()
+                         : winner.load() >= 0 ? &frontier[winner.load()] : nullptr;
+    for (const SolveResult& result : results) {
+        puzzle.getSteps() += result.steps;
+    }
+    if (solved != nullptr) {
+        puzzle.fillFrom(solved->getCells());
+        SUDOKU_STAT(puzzle.getStats() += solved->getStats());
+        return true;
+    }
+    // A budget abort is what cancelled the other tasks, so it names the reason.
+    AbortReason reason = AbortReason::None;
+    for (const SolveResult& result : results) {
+        if (result.abortReason != AbortReason::None &&
+            (reason == AbortReason::None || reason == AbortReason::Cancelled)) {
+            reason = result.abortReason;
+        }
+    }
+    if (reason != AbortReason::None) {
+        puzzle.getGuard().abort(reason);
+    }
+    return false;
+}
+
+// Uses one process-wide pool. Calls from a pool worker (parallel batches) or
+// with a display hook run the fixed engine directly instead.
+bool parallelSolver(Sudoku& sudoku, function<void()> displayFunction) {
+    if (displayFunction || WorkStealingPool::onWorkerThread()) {
+        return specializedSolver(sudoku, displayFunction);
+    }
+    
+    static WorkStealingPool pool(WorkStealingPool::defaultThreadCount());
+    static mutex solveLock;
+    if (pool.getThreadCount() < 2) {
+        return specializedSolver(sudoku, displayFunction);
+    }
+    lock_guard<mutex> guard(solveLock);
+    return solveParallel(sudoku, pool, specializedSolver);
+}
+
+int runCountCommand(const string& inputPath, long long limit, bool printSolutions, int threadCount) {
+    FILE* input = stdin;
+    if (!inputPath.empty() && inputPath != "-") {
+        input = fopen(inputPath.c_str(), "rb");
+        if (input == nullptr) {
+            cerr << "Cannot open " << inputPath << ": " << strerror(errno) << endl;
+            return 1;
+        }
+    }
+    
+    unique_ptr<WorkStealingPool> pool;
+    if (threadCount > 1 && !printSolutions) {
+        pool = make_unique<WorkStealingPool>(threadCount);
+    }
+    
+    LineReader reader(input);
+    OutputBuffer writer(stdout);
+    SolveContext context;
+    long long invalid = 0;
+    
+    const char* line;
+    size_t length;
+    while (reader.next(line, length)) {
+        if (length == 0 || line[0] == '#') {
+            continue;
+        }
+        
+        Sudoku* sudoku = context.load(line, length);
+        if (sudoku == nullptr) {
+            writer.append("invalid\n", 8);
+            ++invalid;
+            continue;
+        }
+        
+        long long count;
+        if (printSolutions) {
+            count = sudoku->enumerateSolutions([&](const uint8_t*) {
+                char* out = writer.reserve(length + 1);
+                sudoku->writeBoard(out);
+                out[length] = '\n';
+                return true;
+            }, limit);
+        } else {
+            count = countSolutionsParallel(*sudoku, limit, pool.get());
+        }
+        
+        string summary = to_string(count) + (count >= limit ? "+\n" : "\n");
+        writer.append(summary.data(), summary.size());
+    }
+    
+    if (input != stdin) {
+        fclose(input);
+    }
+    return invalid > 0 ? 2 : 0;
+}
+
+// Pairs every puzzle line (blank and '#' lines skipped, as in --batch) with
+// the next line of the solutions file and checks givens, completeness and
+// consistency; boards are converted in blocks so validateBatch can take eight
+// at a time, and only failures pay for a detailed report.
+int runVerifyCommand(const string& puzzlePath, const string& solutionPath) {
+    static constexpr size_t BLOCK_BOARDS = 1 << 12;
+    
+    FILE* puzzleInput = fopen(puzzlePath.c_str(), "rb");
+    if (puzzleInput == nullptr) {
+        cerr << "Cannot open " << puzzlePath << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    FILE* solutionInput = fopen(solutionPath.c_str(), "rb");
+    if (solutionInput == nullptr) {
+        cerr << "Cannot open " << solutionPath << ": " << strerror(errno) << endl;
+        fclose(puzzleInput);
+        return 1;
+    }
+    
+    auto start = chrono::steady_clock::now();
+    LineReader puzzles(puzzleInput);
+    LineReader solutions(solutionInput);
+    OutputBuffer writer(stdout);
+    long long verified = 0;
+    long long failed = 0;
+    
+    int blockSize = 0;
+    vector<uint8_t> givens;
+    vector<uint8_t> boards;
+    vector<long long> lineNumbers;
+    vector<uint8_t> valid;
+    
+    auto fail = [&](long long lineNumber, const string& reason) {
+        string message = "line " + to_string(lineNumber) + ": " + reason + "\n";
+        writer.append(message.data(), message.size());
+        ++failed;
+    };
+    
+    auto flush = [&]() {
+        size_t count = lineNumbers.size();
+        if (count == 0) {
+            return;
+        }
+        size_t cellCount = static_cast<size_t>(blockSize) * blockSize;
+        int boxSize = static_cast<int>(sqrt(blockSize));
+        valid.resize(count);
+        validateBatch(boards.data(), count, blockSize, boxSize, valid.data());
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t* puzzle = givens.data() + i * cellCount;
+            const uint8_t* solution = boards.data() + i * cellCount;
+            bool keepsGivens = true;
+            for (size_t cell = 0; cell < cellCount && keepsGivens; ++cell) {
+                keepsGivens = puzzle[cell] == 0 || puzzle[cell] == solution[cell];
+            }
+            if (valid[i] && keepsGivens) {
+                ++verified;
+                continue;
+            }
+            fail(lineNumbers[i], describeValidation(verifySolution(puzzle, solution, blockSize, boxSize), blockSize));
+        }
+        givens.clear();
+        boards.clear();
+        lineNumbers.clear();
+    };
+    
+    const char* puzzleLine;
+    size_t puzzleLength;
+    long long lineNumber = 0;
+    while (puzzles.next(puzzleLine, puzzleLength)) {
+        if (puzzleLength == 0 || puzzleLine[0] == '#') {
+            continue;
+        }
+        const char* solutionLine;
+        size_t solutionLength;
+        ++lineNumber;
+        if (!solutions.next(solutionLine, solutionLength)) {
+            fail(lineNumber, "missing solution");
+            continue;
+        }
+        
+        optional<int> boardSize = detectBoardSize(puzzleLength);
+        int boxSize = boardSize.has_value() ? static_cast<int>(sqrt(boardSize.value())) : 0;
+        if (!boardSize.has_value() || boardSize.value() > Sudoku::MAX_SIZE || boxSize * boxSize != boardSize.value()) {
+            fail(lineNumber, "puzzle is not a square board");
+            continue;
+        }
+        if (solutionLength != puzzleLength) {
+            fail(lineNumber, "not a solution: " + string(solutionLine, min<size_t>(solutionLength, 32)));
+            continue;
+        }
+        if (boardSize.value() != blockSize || lineNumbers.size() == BLOCK_BOARDS) {
+            flush();
+            blockSize = boardSize.value();
+        }
+        
+        size_t offset = boards.size();
+        givens.resize(offset + puzzleLength);
+        boards.resize(offset + puzzleLength);
+        bool readable = true;
+        for (size_t cell = 0; cell < puzzleLength; ++cell) {
+            int given = valueForSymbol(puzzleLine[cell]);
+            int value = valueForSymbol(solutionLine[cell]);
+            readable &= given >= 0 && value >= 0;
+            givens[offset + cell] = static_cast<uint8_t>(max(given, 0));
+            boards[offset + cell] = static_cast<uint8_t>(max(value, 0));
+        }
+        if (!readable) {
+            givens.resize(offset);
+            boards.resize(offset);
+            fail(lineNumber, "unreadable symbol");
+            continue;
+        }
+        lineNumbers.push_back(lineNumber);
+    }
+    flush();
+    
+    fclose(puzzleInput);
+    fclose(solutionInput);
+    
+    writer.flush();
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+    cerr << "Verified " << verified << ", failed " << failed << " in " << elapsed.count() << " ms" << endl;
+    return failed > 0 ? 3 : 0;
+}
+
+volatile sig_atomic_t searchInterrupted = 0;
+
+extern "C" void interruptSearch(int) {
+    searchInterrupted = 1;
+}
+
+bool readTextFile(const string& path, string& text) {
+    FILE* input = fopen(path.c_str(), "rb");
+    if (input == nullptr) {
+        return false;
+    }
+    text.clear();
+    char chunk[1 << 16];
+    size_t bytesRead;
+    while ((bytesRead = fread(chunk, 1, sizeof(chunk), input)) > 0) {
+        text.append(chunk, bytesRead);
+    }
+    bool ok = ferror(input) == 0;
+    fclose(input);
+    return ok;
+}
+
+// Writes beside the target and renames over it, so a node killed mid-write
+// still leaves the previous checkpoint intact.
+bool writeCheckpoint(const string& path, const SearchCursor& cursor) {
+    string temporary = path + ".tmp";
+    FILE* output = fopen(temporary.c_str(), "wb");
+    if (output == nullptr) {
+        return false;
+    }
+    string text = cursor.serialize();
+    bool ok = fwrite(text.data(), 1, text.size(), output) == text.size();
+    ok &= fflush(output) == 0 && fsync(fileno(output)) == 0;
+    ok &= fclose(output) == 0;
+    return ok && rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+optional<SearchCursor> loadCheckpoint(const string& path) {
+    string text;
+    if (!readTextFile(path, text)) {
+        return nullopt;
+    }
+    try {
+        return SearchCursor::parse(text);
+    } catch (const invalid_argument& error) {
+        cerr << path << ": " << error.what() << endl;
+        return nullopt;
+    }
+}
+
+// Counts the first puzzle of the input as a resumable search. An existing
+// checkpoint is resumed instead of reading the input, so rerunning the same
+// command after preemption picks up where the last save left off.
+int runCheckpointedCount(const string& inputPath, const string& checkpointPath, long long limit,
+                         double saveEverySeconds) {
+    static constexpr long long NODES_PER_POLL = 1 << 14;
+    
+    optional<SearchCursor> cursor;
+    if (access(checkpointPath.c_str(), F_OK) == 0) {
+        cursor = loadCheckpoint(checkpointPath);
+        if (!cursor.has_value()) {
+            return 1;
+        }
+        cerr << "Resuming " << checkpointPath << " at " << cursor->getFound() << " solutions, "
+             << cursor->getNodes() << " nodes" << endl;
+    } else {
+        FILE* input = stdin;
+        if (!inputPath.empty() && inputPath != "-") {
+            input = fopen(inputPath.c_str(), "rb");
+            if (input == nullptr) {
+                cerr << "Cannot open " << inputPath << ": " << strerror(errno) << endl;
+                return 1;
+            }
+        }
+        LineReader reader(input);
+        SolveContext context;
+        const char* line;
+        size_t length;
+        Sudoku* sudoku = nullptr;
+        while (sudoku == nullptr && reader.next(line, length)) {
+            if (length == 0 || line[0] == '#') {
+                continue;
+            }
+            sudoku = context.load(line, length);
+            if (sudoku == nullptr) {
+                cout << "invalid" << endl;
+                return 2;
+            }
+        }
+        if (input != stdin) {
+            fclose(input);
+        }
+        if (sudoku == nullptr) {
+            cerr << "No puzzle to count" << endl;
+            return 1;
+        }
+        cursor.emplace(*sudoku);
+    }
+    
+    struct sigaction action{};
+    action.sa_handler = interruptSearch;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    
+    auto saveInterval = chrono::duration<double>(saveEverySeconds);
+    auto lastSave = chrono::steady_clock::now();
+    while (!cursor->run(limit, NODES_PER_POLL)) {
+        bool due = chrono::steady_clock::now() - lastSave >= saveInterval;
+        if (!due && !searchInterrupted) {
+            continue;
+        }
+        if (!writeCheckpoint(checkpointPath, *cursor)) {
+            cerr << "Cannot write " << checkpointPath << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        lastSave = chrono::steady_clock::now();
+        if (searchInterrupted) {
+            cerr << "Interrupted at " << cursor->getFound() << " solutions; resume from " << checkpointPath << endl;
+            return 130;
+        }
+    }
+    
+    if (!writeCheckpoint(checkpointPath, *cursor)) {
+        cerr << "Cannot write " << checkpointPath << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    long long count = min(cursor->getFound(), limit);
+    cout << count << (count >= limit ? "+" : "") << endl;
+    return 0;
+}
+
+// Splits the remaining work of a checkpoint into parts: the original file plus
+// PATH.1 .. PATH.(N-1), each resumable on its own. The part counts add up to
+// the total; any part reaching the limit means the total did too.
+int runSplitCommand(const string& checkpointPath, int parts) {
+    optional<SearchCursor> source = loadCheckpoint(checkpointPath);
+    if (!source.has_value()) {
+        cerr << "Cannot load " << checkpointPath << endl;
+        return 1;
+    }
+    
+    vector<SearchCursor> cursors;
+    cursors.push_back(move(source.value()));
+    while (static_cast<int>(cursors.size()) < parts) {
+        size_t donor = 0;
+        for (size_t i = 1; i < cursors.size(); ++i) {
+            if (cursors[i].openDepth() < cursors[donor].openDepth()) {
+                donor = i;
+            }
+        }
+        optional<SearchCursor> part = cursors[donor].split();
+        if (!part.has_value()) {
+            break;
+        }
+        cursors.push_back(move(part.value()));
+    }
+    
+    for (size_t i = 0; i < cursors.size(); ++i) {
+        string path = i == 0 ? checkpointPath : checkpointPath + "." + to_string(i);
+        if (!writeCheckpoint(path, cursors[i])) {
+            cerr << "Cannot write " << path << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        cout << path << endl;
+    }
+    if (static_cast<int>(cursors.size()) < parts) {
+        cerr << "Only " << cursors.size() << " parts left to hand out" << endl;
+    }
+    return 0;
+}
+
+// Puzzle i is always generated from mixSeed(baseSeed, i), so the output only
+// depends on the seed and never on the thread count or scheduling.
+void generatePuzzles(int boardSize, uint64_t baseSeed, size_t firstIndex, size_t count,
+                     char* out, WorkStealingPool* pool, bool packed = false) {
+    static constexpr size_t CHUNK_PUZZLES = 16;
+    
+    size_t lineLength = packed ? packedRecordBytes(boardSize) : static_cast<size_t>(boardSize) * boardSize + 1;
+    int workerCount = pool ? pool->getThreadCount() : 1;
+    vector<optional<Sudoku>> generators(workerCount);
+    
+    auto runChunk = [&](size_t first, size_t last, int worker) {
+        SUDOKU_TRACE_SPAN("generateChunk");
+        optional<Sudoku>& generator = generators[worker];
+        if (!generator.has_value()) {
+            generator = Sudoku::createEmpty(boardSize);
+        }
+        for (size_t i = first; i < last; ++i) {
+            generator->generate(mixSeed(baseSeed, firstIndex + i));
+            char* line = out + i * lineLength;
+            if (packed) {
+                generator->writePacked(reinterpret_cast<uint8_t*>(line));
+                continue;
+            }
+            generator->writeBoard(line);
+            line[lineLength - 1] = '\n';
+        }
+    };
+    
+    for (size_t first = 0; first < count; first += CHUNK_PUZZLES) {
+        size_t last = min(count, first + CHUNK_PUZZLES);
+        if (pool) {
+            pool->submit([&runChunk, first, last](int worker) { runChunk(first, last, worker); });
+        } else {
+            runChunk(first, last, 0);
+        }
+    }
+    if (pool) {
+        pool->wait();
+    }
+}
+
+int runGenerateCommand(size_t count, int boardSize, uint64_t baseSeed, int threadCount, bool packed) {
+    static constexpr size_t BLOCK_PUZZLES = 1 << 12;
+    
+    try {
+        Sudoku::createEmpty(boardSize);
+    } catch (const invalid_argument& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+    
+    unique_ptr<WorkStealingPool> pool;
+    if (threadCount > 1) {
+        pool = make_unique<WorkStealingPool>(threadCount);
+    }
+    
+    size_t lineLength = packed ? packedRecordBytes(boardSize) : static_cast<size_t>(boardSize) * boardSize + 1;
+    vector<char> buffer(min(count, BLOCK_PUZZLES) * lineLength);
+    
+    auto start = chrono::steady_clock::now();
+    if (packed) {
+        OutputBuffer header(stdout, PackedHeader::BYTES);
+        writePackedHeader(header, boardSize, count);
+    }
+    for (size_t first = 0; first < count; first += BLOCK_PUZZLES) {
+        size_t blockCount = min(BLOCK_PUZZLES, count - first);
+        generatePuzzles(boardSize, baseSeed, first, blockCount, buffer.data(), pool.get(), packed);
+        fwrite(buffer.data(), 1, blockCount * lineLength, stdout);
+    }
+    fflush(stdout);
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+    
+    cerr << "Generated " << count << " puzzles (seed " << baseSeed << ") in " << elapsed.count() << " ms" << endl;
+    return 0;
+}
+
+int reportBatchSummary(const BatchSummary& summary, const BatchOptions& options,
+                       chrono::steady_clock::time_point start) {
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+    cerr << "Solved " << summary.solved << ", unsolvable " << summary.unsolvable
+         << ", invalid " << summary.invalid;
+    if (summary.timedOut > 0) {
+        cerr << ", timed out " << summary.timedOut;
+    }
+    if (options.cacheCapacity > 0) {
+        cerr << " (" << summary.cacheHits << " from cache)";
+    }
+    cerr << " in " << elapsed.count() << " ms" << endl;
+    return summary.invalid > 0 ? 2 : 0;
+}
+
+int runBatchCommand(const string& inputPath, const string& solverName, BatchOptions options) {
+    auto solver = findSolver(solverName);
+    if (!solver.has_value()) {
+        cerr << "Unknown solver: " << solverName << endl;
+        return 1;
+    }
+    // Batch kernels answer solved or unsolvable only, so grading, caching
+    // and budgets keep the per-puzzle path of the same engine.
+    bool hasLimits = options.limits.timeLimit.count() > 0 || options.limits.stepLimit > 0;
+    if (!options.grade && options.cacheCapacity == 0 && !hasLimits) {
+        options.backend = findBatchBackend(solverName);
+    }
+    
+    string inputName = inputPath.empty() || inputPath == "-" ? "stdin" : inputPath;
+    auto runPacked = [&](const uint8_t* data, size_t length) {
+        if (options.grade && options.binaryOutput) {
+            cerr << "--grade writes text and cannot be combined with --binary" << endl;
+            return 1;
+        }
+        try {
+            PackedCorpus corpus(data, length);
+            auto start = chrono::steady_clock::now();
+            BatchSummary summary = runPackedBatch(corpus, stdout, solver.value(), options);
+            return reportBatchSummary(summary, options, start);
+        } catch (const invalid_argument& error) {
+            cerr << inputName << ": " << error.what() << endl;
+            return 1;
+        }
+    };
+    
+    MappedFile mapped;
+    if (inputName != "stdin" && mapped.open(inputPath) && PackedCorpus::isPacked(mapped.getData(), mapped.getLength())) {
+        return runPacked(mapped.getData(), mapped.getLength());
+    }
+    
+    FILE* input = stdin;
+    if (inputName != "stdin") {
+        input = fopen(inputPath.c_str(), "rb");
+        if (input == nullptr) {
+            cerr << "Cannot open " << inputPath << ": " << strerror(errno) << endl;
+            return 1;
+        }
+    }
+    
+    // Pipes cannot be mapped, so a packed corpus arriving on one is read whole.
+    char magic[sizeof(PACKED_MAGIC)];
+    size_t magicBytes = fread(magic, 1, sizeof(magic), input);
+    if (magicBytes == sizeof(magic) && memcmp(magic, PACKED_MAGIC, sizeof(magic)) == 0) {
+        vector<uint8_t> corpus(magic, magic + sizeof(magic));
+        uint8_t chunk[1 << 16];
+        size_t bytesRead;
+        while ((bytesRead = fread(chunk, 1, sizeof(chunk), input)) > 0) {
+            corpus.insert(corpus.end(), chunk, chunk + bytesRead);
+        }
+        if (input != stdin) {
+            fclose(input);
+        }
+        return runPacked(corpus.data(), corpus.size());
+    }
+    if (options.binaryOutput) {
+        cerr << "--binary output needs a packed input corpus (see --generate N --binary)" << endl;
+        if (input != stdin) {
+            fclose(input);
+        }
+        return 1;
+    }
+    
+    auto start = chrono::steady_clock::now();
+    BatchSummary summary = runBatch(input, stdout, solver.value(), options, string(magic, magicBytes));
+    
+    if (input != stdin) {
+        fclose(input);
+    }
+    
+    return reportBatchSummary(summary, options, start);
+}
+
+// Text protocol: the client streams puzzle lines, as in --batch, and may keep
+// many in flight; each worker answers every complete line it has buffered
+// with one write per read. Workers own their SolveContext and thread_local
+// engine state, so a connection never pays for warm-up.
+class SolverServer {
+private:
+    static constexpr size_t READ_CHUNK = 1 << 16;
+    static constexpr size_t MAX_LINE = 1 << 20;
+
+    int listenSocket = -1;
+    string unixPath;
+    SolverFunction solver;
+    BatchOptions options;
+    unique_ptr<SolutionCache> cache;
+    mutex queueMutex;
+    condition_variable queueReady;
+    deque<int> pendingConnections;
+    vector<atomic<int>> activeConnections;
+    atomic<bool> stopping{false};
+    vector<thread> workers;
+
+public:
+    SolverServer(SolverFunction solverFunc, const BatchOptions& batchOptions)
+        : solver(move(solverFunc)), options(batchOptions), activeConnections(max(1, batchOptions.threadCount)) {
+        options.binaryOutput = false;
+        options.packedBoardSize = 0;
+        if (options.cacheCapacity > 0 && !options.grade) {
+            cache = make_unique<SolutionCache>(options.cacheCapacity);
+        }
+        for (auto& connection : activeConnections) {
+            connection.store(-1);
+        }
+    }
+
+    ~SolverServer() {
+        stop();
+        if (listenSocket >= 0) {
+            close(listenSocket);
+        }
+        if (!unixPath.empty()) {
+            unlink(unixPath.c_str());
+        }
+    }
+
+    // "host:port" or ":port" listens on TCP; anything else is a Unix socket path.
+    void listenOn(const string& address) {
+        size_t colon = address.rfind(':');
+        if (colon == string::npos || address.find('/') != string::npos) {
+            listenUnix(address);
+        } else {
+            listenTcp(address.substr(0, colon), address.substr(colon + 1));
+        }
+    }
+
+    void run(const volatile sig_atomic_t& interrupted) {
+        // Workers block the stop signals so they always interrupt accept() here.
+        sigset_t stopSignals;
+        sigemptyset(&stopSignals);
+        sigaddset(&stopSignals, SIGINT);
+        sigaddset(&stopSignals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+        for (size_t worker = 0; worker < activeConnections.size(); ++worker) {
+            workers.emplace_back([this, worker]() { serveConnections(worker); });
+        }
+        pthread_sigmask(SIG_UNBLOCK, &stopSignals, nullptr);
+        while (!interrupted) {
+            int connection = accept(listenSocket, nullptr, nullptr);
+            if (connection < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                throw runtime_error(string("accept failed: ") + strerror(errno));
+            }
+            int noDelay = 1;
+            setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            {
+                lock_guard<mutex> lock(queueMutex);
+                pendingConnections.push_back(connection);
+            }
+            queueReady.notify_one();
+        }
+    }
+
+    void stop() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            if (stopping.exchange(true)) {
+                return;
+            }
+        }
+        queueReady.notify_all();
+        for (auto& connection : activeConnections) {
+            int socket = connection.load();
+            if (socket >= 0) {
+                shutdown(socket, SHUT_RDWR);
+            }
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (int connection : pendingConnections) {
+            close(connection);
+        }
+        pendingConnections.clear();
+    }
+
+private:
+    void listenUnix(const string& path) {
+        sockaddr_un address{};
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            throw invalid_argument("Invalid Unix socket path: " + path);
+        }
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(path.c_str());
+        if (listenSocket < 0 || bind(listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(listenSocket, SOMAXCONN) != 0) {
+            throw runtime_error("Cannot listen on " + path + ": " + strerror(errno));
+        }
+        unixPath = path;
+    }
+
+    void listenTcp(const string& host, const string& port) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* results = nullptr;
+        int status = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &results);
+        if (status != 0) {
+            throw invalid_argument("Cannot resolve " + host + ":" + port + ": " + gai_strerror(status));
+        }
+        for (addrinfo* candidate = results; candidate != nullptr; candidate = candidate->ai_next) {
+            int socketFd = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+            if (socketFd < 0) {
+                continue;
+            }
+            int reuse = 1;
+            setsockopt(socketFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            if (bind(socketFd, candidate->ai_addr, candidate->ai_addrlen) == 0 && listen(socketFd, SOMAXCONN) == 0) {
+                listenSocket = socketFd;
+                break;
+            }
+            close(socketFd);
+        }
+        freeaddrinfo(results);
+        if (listenSocket < 0) {
+            throw runtime_error("Cannot listen on " + host + ":" + port + ": " + strerror(errno));
+        }
+    }
+
+    void serveConnections(size_t worker) {
+        SolveContext context(solver);
+        context.setLimits(options.limits);
+        vector<char> input(READ_CHUNK);
+        vector<char> output;
+        while (true) {
+            int connection;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueReady.wait(lock, [this]() { return stopping || !pendingConnections.empty(); });
+                if (stopping) {
+                    return;
+                }
+                connection = pendingConnections.front();
+                pendingConnections.pop_front();
+                activeConnections[worker].store(connection);
+            }
+            serveConnection(connection, context, input, output);
+            activeConnections[worker].store(-1);
+            close(connection);
+        }
+    }
+
+    void serveConnection(int connection, SolveContext& context, vector<char>& input, vector<char>& output) {
+        BatchSummary summary;
+        size_t used = 0;
+        while (true) {
+            if (used == input.size()) {
+                if (input.size() >= MAX_LINE) {
+                    return;
+                }
+                input.resize(input.size() * 2);
+            }
+            ssize_t received = read(connection, input.data() + used, input.size() - used);
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            bool closed = received <= 0;
+            used += closed ? 0 : static_cast<size_t>(received);
+            
+            output.clear();
+            size_t start = 0;
+            for (size_t i = 0; i < used; ++i) {
+                if (input[i] == '\n') {
+                    answerLine(context, input.data() + start, i - start, output, summary);
+                    start = i + 1;
+                }
+            }
+            if (closed && start < used) {
+                answerLine(context, input.data() + start, used - start, output, summary);
+                start = used;
+            }
+            memmove(input.data(), input.data() + start, used - start);
+            used -= start;
+            
+            if (!sendAll(connection, output) || closed) {
+                return;
+            }
+        }
+    }
+
+    void answerLine(SolveContext& context, const char* line, size_t length, vector<char>& output,
+                    BatchSummary& summary) {
+        if (length > 0 && line[length - 1] == '\r') {
+            --length;
+        }
+        if (length == 0 || line[0] == '#') {
+            return;
+        }
+        solveBatchLine(context, cache.get(), {line, length}, options, output, summary);
+    }
+
+    static bool sendAll(int connection, const vector<char>& output) {
+        size_t sent = 0;
+        while (sent < output.size()) {
+            ssize_t written = send(connection, output.data() + sent, output.size() - sent, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            sent += static_cast<size_t>(written);
+        }
+        return true;
+    }
+};
+
+volatile sig_atomic_t serverInterrupted = 0;
+
+extern "C" void interruptServer(int) {
+    serverInterrupted = 1;
+}
+
+int runServeCommand(const string& address, const string& solverName, const BatchOptions& options) {
+    auto solver = findSolver(solverName);
+    if (!solver.has_value()) {
+        cerr << "Unknown solver: " << solverName << endl;
+        return 1;
+    }
+    
+    struct sigaction action{};
+    action.sa_handler = interruptServer;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    
+    try {
+        SolverServer server(solver.value(), options);
+        server.listenOn(address);
+        cerr << "Serving " << solverName << " on " << address << " with " << options.threadCount
+             << " workers" << endl;
+        server.run(serverInterrupted);
+    } catch (const exception& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+    cerr << "Server stopped" << endl;
+    return 0;
+}
+
+struct BenchCorpus {
+    const char* name;
+    vector<string> puzzles;
+};
+
+vector<BenchCorpus> standardBenchCorpora() {
+    return {
+        {"easy", {
+            "003020600900305001001806400008102900700000008006708200002609500800203009005010300",
+            "200080300060070084030500209000105408000000000402706000301007040720040060004010003",
+            "000000907000420180000705026100904000050000040000507009920108000034059000507000000",
+        }},
+        {"hard", {
+            "800000000003600000070090200050007000000045700000100030001000068008500010090000400",
+            "4.....8.5.3..........7......2.....6.....8.4......1.......6.3.7.5..2.....1.4......",
+            "52...6.........7.13...........4..8..6......5...........418.........3..2...87.....",
+            "6.....8.3.4.7.................5.4.7.3..2.....1.6.......2.....5.....8.6......1....",
+            "48.3............71.2.......7.5....6....2..8.............1.76...3.....4......5....",
+            "....14....3....2...7..........9...3.6.1.............8.2.....1.4....5.6.....7.8...",
+            "85...24..72......9..4.........1.7..23.5...9...4...........8..7..17..........36.4.",
+            "..53.....8......2..7..1.5..4....53...1..7...6..32...8..6.5....9..4....3......97..",
+            "12.3....435....1....4........54..2..6...7.........8.9...31..5.......9.7.....6...8",
+        }},
+        {"17-clue", {
+            "000000010400000000020000000000050407008000300001090000300400200050100000000806000",
+            "000000010400000000020000000000050604008000300001090000300400200050100000000807000",
+            "000000012000035000000600070700000300000400800100000000000120000080000040050000600",
+            "000000012003600000000007000410020000000500300700000600280000040000300500000000000",
+            "000000012008030000000000040120500000000004700060000000507000300000620000000100000",
+        }},
+    };
+}
+
+struct BenchTimings {
+    vector<long long> nanoseconds;
+    long long allocations = 0;
+    double seconds = 0;
+};
+
+template <typename Operation>
+BenchTimings measureRepeatedly(size_t itemCount, double minSeconds, Operation operation) {
+    for (size_t i = 0; i < itemCount; ++i) {
+        operation(i);
+    }
+    
+    BenchTimings timings;
+    auto start = chrono::steady_clock::now();
+    while (timings.seconds < minSeconds || timings.nanoseconds.empty()) {
+        for (size_t i = 0; i < itemCount; ++i) {
+            long long allocationsBefore = allocationsOnThisThread();
+            auto begin = chrono::steady_clock::now();
+            operation(i);
+            auto end = chrono::steady_clock::now();
+            timings.allocations += allocationsOnThisThread() - allocationsBefore;
+            timings.nanoseconds.push_back(chrono::duration_cast<chrono::nanoseconds>(end - begin).count());
+        }
+        timings.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    return timings;
+}
+
+void printBenchRow(const string& engine, const string& corpus, BenchTimings& timings) {
+    sort(timings.nanoseconds.begin(), timings.nanoseconds.end());
+    size_t count = timings.nanoseconds.size();
+    auto percentile = [&](double fraction) {
+        return timings.nanoseconds[min(count - 1, static_cast<size_t>(fraction * count))];
+    };
+    long long total = accumulate(timings.nanoseconds.begin(), timings.nanoseconds.end(), 0LL);
+    
+    char allocations[32] = "-";
+    if (SUDOKU_COUNT_ALLOCATIONS) {
+        snprintf(allocations, sizeof(allocations), "%.2f", static_cast<double>(timings.allocations) / count);
+    }
+    printf("%-10s %-10s %12.0f %12lld %12lld %12lld %12lld %10s\n",
+           engine.c_str(), corpus.c_str(), count / (total / 1e9),
+           percentile(0.5), percentile(0.9), percentile(0.99), timings.nanoseconds.back(), allocations);
+}
+
+int runBenchCommand(double minSeconds, uint64_t baseSeed) {
+    static constexpr size_t GENERATED_PUZZLES = 200;
+    static const char* const ENGINES[] = {"brute", "propagate", "logic", "fixed", "dlx", "lanes", "portfolio",
+                                          "parallel"};
+    
+    vector<BenchCorpus> corpora = standardBenchCorpora();
+    printf("%-10s %-10s %12s %12s %12s %12s %12s %10s\n",
+           "engine", "corpus", "puzzles/s", "p50 ns", "p90 ns", "p99 ns", "max ns", "allocs");
+    
+    BenchCorpus generated{"generated", vector<string>(GENERATED_PUZZLES, string(81, '.'))};
+    Sudoku generator = Sudoku::createEmpty(9);
+    BenchTimings generation = measureRepeatedly(GENERATED_PUZZLES, minSeconds, [&](size_t i) {
+        generator.generate(mixSeed(baseSeed, i));
+        generator.writeBoard(generated.puzzles[i].data());
+    });
+    printBenchRow("generator", "9x9", generation);
+    corpora.insert(corpora.begin(), generated);
+    
+    for (const char* engine : ENGINES) {
+        Sudoku sudoku = Sudoku::createEmpty(9, findSolver(engine).value());
+        for (const BenchCorpus& corpus : corpora) {
+            bool allSolved = true;
+            BenchTimings timings = measureRepeatedly(corpus.puzzles.size(), minSeconds, [&](size_t i) {
+                const string& puzzle = corpus.puzzles[i];
+                sudoku.loadPuzzle(puzzle.data(), puzzle.size());
+                allSolved &= sudoku.solveHeadless().solved;
+            });
+            printBenchRow(engine, corpus.name, timings);
+            if (!allSolved) {
+                cerr << engine << " failed to solve a puzzle in the " << corpus.name << " corpus" << endl;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+void printUsage(const char* program) {
+    cerr << "Usage: " << program << " [--batch [FILE] | --generate N] [--solver NAME] [--threads N]\n"
+         << "                [--size N] [--seed S] [--count LIMIT | --enumerate LIMIT] [--fps N] [--fast]\n"
+         << "  (no options)     animated solve of a freshly generated puzzle\n"
+         << "  --batch [FILE]   solve one puzzle per line from FILE or stdin ('.' or '0' = empty);\n"
+         << "                   a packed corpus FILE is memory-mapped and solved in place\n"
+         << "  --serve ADDRESS  answer puzzle lines over a Unix socket path or TCP host:port (:port = all)\n"
+         << "  --generate N     write N unique puzzles to stdout, one per line\n"
+         << "  --size N         board size for generation (default 9)\n"
+         << "  --seed S         base seed; the same seed always yields the same puzzles\n"
+         << "  --count LIMIT    with --batch: print the number of solutions, capped at LIMIT ('+' = capped)\n"
+         << "  --enumerate LIMIT  with --batch: print up to LIMIT solutions, then their count\n"
+         << "  --checkpoint FILE  with --batch --count: count the first puzzle as a resumable search saved\n"
+         << "                   to FILE (every --checkpoint-every SECONDS, default 60, and on SIGINT/SIGTERM);\n"
+         << "                   an existing FILE is resumed\n"
+         << "  --split N FILE   divide a checkpoint's remaining search into FILE, FILE.1 .. FILE.(N-1)\n"
+         << "  --grade          with --batch: print a difficulty grade and solver counters per puzzle\n"
+         << "  --verify PUZZLES SOLUTIONS  check each solution line against its puzzle's givens and rules\n"
+         << "  --trace FILE     record phase timings and write them to FILE as Chrome trace JSON\n"
+         << "  --bench [SECONDS]  benchmark the generator and every engine on the built-in corpora\n"
+         << "  --solver NAME    solver engine: brute (default), propagate, fixed, dlx,\n"
+         << "                   logic (singles, locked candidates, pairs/triples, X-wing; guesses last),\n"
+         << "                   portfolio (races fixed, dlx and brute; first answer wins),\n"
+         << "                   parallel (splits one search across all cores),\n"
+         << "                   lanes (data-parallel 9x9 batch kernel, 16 puzzles per lane group)\n"
+         << "  --timeout MS     with --batch/--serve: give up on a puzzle after MS milliseconds ('timeout')\n"
+         << "  --max-steps N    with --batch/--serve: give up on a puzzle after N search steps ('timeout')\n"
+         << "  --cache N        with --batch: reuse solutions of up to N puzzles, matched up to symmetry\n"
+         << "  --binary         write the packed binary format (--generate, or --batch on a packed corpus)\n"
+         << "  --threads N      batch worker threads (default: all cores)\n"
+         << "  --fps N          animation frame rate (default 30)\n"
+         << "  --fast           animate without per-step delays; the solver runs at full speed" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    bool batchMode = false;
+    optional<string> serveAddress;
+    optional<size_t> generateCount;
+    int boardSize = 9;
+    uint64_t baseSeed = randomSeed();
+    string inputPath;
+    optional<long long> solutionLimit;
+    bool enumerate = false;
+    bool grade = false;
+    optional<double> benchSeconds;
+    optional<pair<string, string>> verifyPaths;
+    string tracePath;
+    string checkpointPath;
+    double checkpointSeconds = 60;
+    optional<pair<int, string>> splitRequest;
+    optional<string> solverName;
+    int threadCount = WorkStealingPool::defaultThreadCount();
+    int framesPerSecond = Sudoku::RENDER_FPS;
+    bool paced = true;
+    bool binary = false;
+    size_t cacheCapacity = 0;
+    SolveLimits limits;
+    
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--batch") {
+            batchMode = true;
+            if (i + 1 < argc && (argv[i + 1][0] != '-' || string(argv[i + 1]) == "-")) {
+                inputPath = argv[++i];
+            }
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serveAddress = argv[++i];
+        } else if (arg == "--solver" && i + 1 < argc) {
+            solverName = argv[++i];
+        } else if (arg == "--bench") {
+            benchSeconds = 0.5;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                benchSeconds = atof(argv[++i]);
+            }
+        } else if (arg == "--verify" && i + 2 < argc) {
+            verifyPaths = make_pair(string(argv[i + 1]), string(argv[i + 2]));
+            i += 2;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpointPath = argv[++i];
+        } else if (arg == "--checkpoint-every" && i + 1 < argc) {
+            checkpointSeconds = max(0.0, atof(argv[++i]));
+        } else if (arg == "--split" && i + 2 < argc) {
+            splitRequest = make_pair(max(1, atoi(argv[i + 1])), string(argv[i + 2]));
+            i += 2;
+        } else if (arg == "--grade") {
+            grade = true;
+        } else if (arg == "--generate" && i + 1 < argc) {
+            generateCount = strtoull(argv[++i], nullptr, 10);
+        } else if ((arg == "--count" || arg == "--enumerate") && i + 1 < argc) {
+            enumerate = arg == "--enumerate";
+            solutionLimit = max(1LL, atoll(argv[++i]));
+        } else if (arg == "--size" && i + 1 < argc) {
+            boardSize = atoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            baseSeed = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threadCount = max(1, atoi(argv[++i]));
+        } else if (arg == "--fps" && i + 1 < argc) {
+            framesPerSecond = max(1, atoi(argv[++i]));
+        } else if (arg == "--fast") {
+            paced = false;
+        } else if (arg == "--binary") {
+            binary = true;
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            limits.timeLimit = chrono::milliseconds(max(0LL, atoll(argv[++i])));
+        } else if (arg == "--max-steps" && i + 1 < argc) {
+            limits.stepLimit = max(0LL, atoll(argv[++i]));
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cacheCapacity = strtoull(argv[++i], nullptr, 10);
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+    
+    if (benchSeconds.has_value()) {
+        return runBenchCommand(benchSeconds.value(), baseSeed);
+    }
+    // The grader reads the solver counters, which SUDOKU_ENABLE_STATS=0
+    // compiles out; grading would report every puzzle as easy.
+    if (grade && !SUDOKU_ENABLE_STATS) {
+        cerr << "--grade needs solver statistics; rebuild without -DSUDOKU_ENABLE_STATS=0" << endl;
+        return 1;
+    }
+    
+    TraceSession traceSession(tracePath);
+    if (verifyPaths.has_value()) {
+        return runVerifyCommand(verifyPaths->first, verifyPaths->second);
+    }
+    if (serveAddress.has_value()) {
+        BatchOptions options;
+        options.threadCount = threadCount;
+        options.grade = grade;
+        options.cacheCapacity = cacheCapacity;
+        options.limits = limits;
+        return runServeCommand(serveAddress.value(), solverName.value_or("fixed"), options);
+    }
+    if (splitRequest.has_value()) {
+        return runSplitCommand(splitRequest->second, splitRequest->first);
+    }
+    if (batchMode && solutionLimit.has_value() && !checkpointPath.empty() && !enumerate) {
+        return runCheckpointedCount(inputPath, checkpointPath, solutionLimit.value(), checkpointSeconds);
+    }
+    if (batchMode && solutionLimit.has_value()) {
+        return runCountCommand(inputPath, solutionLimit.value(), enumerate, threadCount);
+    }
+    if (batchMode) {
+        BatchOptions options;
+        options.threadCount = threadCount;
+        options.grade = grade;
+        options.binaryOutput = binary;
+        options.cacheCapacity = cacheCapacity;
+        options.limits = limits;
+        return runBatchCommand(inputPath, solverName.value_or(grade ? "fixed" : "brute"), options);
+    }
+    if (generateCount.has_value()) {
+        return runGenerateCommand(generateCount.value(), boardSize, baseSeed, threadCount, binary);
+    }
+    
+    auto solver = findSolver(solverName.value_or("brute"));
+    if (!solver.has_value()) {
+        cerr << "Unknown solver: " << solverName.value_or("brute") << endl;
+        return 1;
+    }
+    
     cout << "\nINITIALIZING SUDOKU SOLVER...\n" << endl;
     this_thread::sleep_for(chrono::seconds(1));
     
-    Sudoku sudoku(9, bruteForceSolver);
-    sudoku.solve();
+    Sudoku sudoku(boardSize, solver.value());
+    sudoku.solve(framesPerSecond, paced);
     
     return 0;
 }
\ No newline at end of file